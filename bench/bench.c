@@ -0,0 +1,617 @@
+/*
+ * libconfigini benchmarks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../src/configini.h"
+#include "gen.h"
+#include "hist.h"
+#include "perf.h"
+
+
+#define LOG_ERR(fmt, ...)	\
+	fprintf(stderr, "[ERROR] <%s:%d> : " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
+
+#define NSEC_PER_SEC	1000000000ULL
+#define MB				(1024 * 1024)
+
+
+/*
+ * Allocation counting: the benchmark is linked with --wrap for the allocator
+ * functions the library uses, so every call made by the library lands here.
+ */
+static unsigned long long numofallocs;
+static unsigned long long allocbytes;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup (const char *s);
+
+void *__wrap_malloc(size_t size)
+{
+	__atomic_add_fetch(&numofallocs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocbytes, size, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&numofallocs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocbytes, nmemb * size, __ATOMIC_RELAXED);
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	__atomic_add_fetch(&numofallocs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocbytes, size, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+	__atomic_add_fetch(&numofallocs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocbytes, strlen(s) + 1, __ATOMIC_RELAXED);
+	return __real_strdup(s);
+}
+
+
+/**
+ * \brief Measurement of one benchmark
+ */
+typedef struct Bench
+{
+	const char         *name;
+	unsigned long long  numofops;
+	unsigned long long  bytes;       /* bytes processed, 0 if throughput is meaningless */
+	unsigned long long  start_ns;
+	unsigned long long  start_allocs;
+	unsigned long long  start_allocbytes;
+	PerfCounters        start_perf;
+} Bench;
+
+static bool perfon;       /* hardware counters are reported */
+
+static unsigned long long NowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void BenchStart(Bench *b, const char *name)
+{
+	b->name = name;
+	b->numofops = 0;
+	b->bytes = 0;
+	b->start_allocs = numofallocs;
+	b->start_allocbytes = allocbytes;
+	if (perfon)
+		PerfRead(&b->start_perf);
+	b->start_ns = NowNs();
+}
+
+/* prints counter of event per op, or ratio of two counters if per is given */
+static void BenchPrintPerf(const PerfCounters *end, const PerfCounters *start, PerfEvent ev,
+		int per, double ops)
+{
+	double value = end->value[ev] - start->value[ev];
+	double div   = (per >= 0) ? end->value[per] - start->value[per] : ops;
+
+	if ( (end->value[ev] < 0) || ((per >= 0) && (end->value[per] < 0)) || (div <= 0) )
+		printf(" %10s", "-");
+	else
+		printf(" %10.2f", value / div);
+}
+
+static void BenchStop(Bench *b)
+{
+	unsigned long long ns     = NowNs() - b->start_ns;
+	unsigned long long allocs = numofallocs - b->start_allocs;
+	unsigned long long abytes = allocbytes - b->start_allocbytes;
+	double             ops    = b->numofops ? (double) b->numofops : 1;
+	PerfCounters       pc;
+
+	if (perfon)
+		PerfRead(&pc);
+
+	printf("%-28s %12llu %12.1f %10.1f %10.2f %12.1f", b->name, b->numofops, ns / ops,
+			b->bytes ? (b->bytes / 1e6) / (ns / 1e9) : 0.0, allocs / ops, abytes / ops);
+
+	if (perfon) {
+		BenchPrintPerf(&pc, &b->start_perf, PERF_CYCLES,        -1,          ops);
+		BenchPrintPerf(&pc, &b->start_perf, PERF_INSTRUCTIONS,  PERF_CYCLES, ops);
+		BenchPrintPerf(&pc, &b->start_perf, PERF_L1D_MISSES,    -1,          ops);
+		BenchPrintPerf(&pc, &b->start_perf, PERF_LLC_MISSES,    -1,          ops);
+		BenchPrintPerf(&pc, &b->start_perf, PERF_BRANCH_MISSES, -1,          ops);
+	}
+	printf("\n");
+}
+
+static void BenchHeader(void)
+{
+	printf("%-28s %12s %12s %10s %10s %12s", "benchmark", "ops", "ns/op", "MB/s", "allocs/op", "bytes/op");
+	if (perfon)
+		printf(" %10s %10s %10s %10s %10s", "cycles/op", "IPC", "L1d-mis/op", "LLC-mis/op", "br-mis/op");
+	printf("\n");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * \brief Generated config and the names used to look it up
+ */
+typedef struct BenchData
+{
+	GenParams   gp;
+	char        filename[64];
+	size_t      filesize;
+	int         numoflookups;
+	char      **sects;           /* section of each lookup */
+	char      **keys;            /* key of each lookup */
+} BenchData;
+
+static int BenchDataInit(BenchData *bd, int numoflookups)
+{
+	unsigned long long state = bd->gp.seed | 1;
+	FILE              *fp;
+	char               buf[256];
+	int                fd, i, s, k;
+
+	strcpy(bd->filename, "/tmp/configini-bench-XXXXXX");
+	if ((fd = mkstemp(bd->filename)) < 0)
+		return -1;
+
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		return -1;
+	}
+	bd->filesize = GenWrite(&bd->gp, fp);
+	fclose(fp);
+
+	bd->numoflookups = numoflookups;
+	bd->sects = malloc(numoflookups * sizeof(char *));
+	bd->keys  = malloc(numoflookups * sizeof(char *));
+
+	for (i = 0; i < numoflookups; ++i) {
+		s = GenRand(&state) % bd->gp.numofsect;
+		k = GenRand(&state) % bd->gp.numofkeys;
+		GenSectName(&bd->gp, s, buf, sizeof(buf));
+		bd->sects[i] = strdup(buf);
+		GenKeyName(&bd->gp, s, k, buf, sizeof(buf));
+		bd->keys[i] = strdup(buf);
+	}
+
+	return 0;
+}
+
+static void BenchDataFree(BenchData *bd)
+{
+	int i;
+
+	for (i = 0; i < bd->numoflookups; ++i) {
+		free(bd->sects[i]);
+		free(bd->keys[i]);
+	}
+	free(bd->sects);
+	free(bd->keys);
+	unlink(bd->filename);
+}
+
+/* adds typed keys to every section so typed reads can hit */
+static void AddTypedKeys(Config *cfg, const BenchData *bd)
+{
+	char sect[256];
+	int  s;
+
+	for (s = 0; s < bd->gp.numofsect; ++s) {
+		GenSectName(&bd->gp, s, sect, sizeof(sect));
+		ConfigAddInt        (cfg, sect, "int",    -12345);
+		ConfigAddUnsignedInt(cfg, sect, "uint",   12345);
+		ConfigAddFloat      (cfg, sect, "float",  1.5);
+		ConfigAddDouble     (cfg, sect, "double", 2.5);
+		ConfigAddBool       (cfg, sect, "bool",   true);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void BenchReadFile(const BenchData *bd, int iterations)
+{
+	Config *cfg;
+	Bench   b;
+	int     i;
+
+	BenchStart(&b, "ConfigReadFile");
+	for (i = 0; i < iterations; ++i) {
+		cfg = NULL;
+		if (ConfigReadFile(bd->filename, &cfg) != CONFIG_OK) {
+			LOG_ERR("ConfigReadFile failed for %s", bd->filename);
+			return;
+		}
+		ConfigFree(cfg);
+		b.bytes += bd->filesize;
+		++b.numofops;
+	}
+	BenchStop(&b);
+}
+
+/* parses from memory, so the numbers exclude file io; handles are freed outside the timing */
+static void BenchRead(const BenchData *bd, int iterations)
+{
+	Config **cfgs;
+	char    *data;
+	FILE    *fp;
+	Bench    b;
+	int      i;
+
+	if ((fp = fopen(bd->filename, "r")) == NULL)
+		return;
+	data = malloc(bd->filesize);
+	if ( !data || (fread(data, 1, bd->filesize, fp) != bd->filesize) ) {
+		LOG_ERR("cannot read %s", bd->filename);
+		free(data);
+		fclose(fp);
+		return;
+	}
+	fclose(fp);
+
+	cfgs = calloc(iterations, sizeof(Config *));
+
+	BenchStart(&b, "ConfigRead");
+	for (i = 0; i < iterations; ++i) {
+		if ((fp = fmemopen(data, bd->filesize, "r")) == NULL)
+			break;
+		ConfigRead(fp, &cfgs[i]);
+		fclose(fp);
+		b.bytes += bd->filesize;
+		++b.numofops;
+	}
+	BenchStop(&b);
+
+	for (i = 0; i < iterations; ++i)
+		ConfigFree(cfgs[i]);
+	free(cfgs);
+	free(data);
+}
+
+static void BenchReads(Config *cfg, const BenchData *bd)
+{
+	char          sbuf[4096];
+	int           iv;
+	unsigned int  uv;
+	float         fv;
+	double        dv;
+	bool          bv;
+	Bench         b;
+	int           i, n = bd->numoflookups;
+
+#define BENCH_READ(name, call)							\
+	do {												\
+		BenchStart(&b, name);							\
+		for (i = 0; i < n; ++i)							\
+			call;										\
+		b.numofops = n;									\
+		BenchStop(&b);									\
+	} while (0)
+
+	BENCH_READ("ConfigReadString hit",      ConfigReadString(cfg, bd->sects[i], bd->keys[i], sbuf, sizeof(sbuf), ""));
+	BENCH_READ("ConfigReadString miss-key", ConfigReadString(cfg, bd->sects[i], "no-such-key", sbuf, sizeof(sbuf), ""));
+	BENCH_READ("ConfigReadString miss-sect",ConfigReadString(cfg, "no-such-section", bd->keys[i], sbuf, sizeof(sbuf), ""));
+
+	BENCH_READ("ConfigReadInt hit",         ConfigReadInt(cfg, bd->sects[i], "int", &iv, 0));
+	BENCH_READ("ConfigReadInt miss",        ConfigReadInt(cfg, bd->sects[i], "no-such-key", &iv, 0));
+	BENCH_READ("ConfigReadUnsignedInt hit", ConfigReadUnsignedInt(cfg, bd->sects[i], "uint", &uv, 0));
+	BENCH_READ("ConfigReadUnsignedInt miss",ConfigReadUnsignedInt(cfg, bd->sects[i], "no-such-key", &uv, 0));
+	BENCH_READ("ConfigReadFloat hit",       ConfigReadFloat(cfg, bd->sects[i], "float", &fv, 0));
+	BENCH_READ("ConfigReadFloat miss",      ConfigReadFloat(cfg, bd->sects[i], "no-such-key", &fv, 0));
+	BENCH_READ("ConfigReadDouble hit",      ConfigReadDouble(cfg, bd->sects[i], "double", &dv, 0));
+	BENCH_READ("ConfigReadDouble miss",     ConfigReadDouble(cfg, bd->sects[i], "no-such-key", &dv, 0));
+	BENCH_READ("ConfigReadBool hit",        ConfigReadBool(cfg, bd->sects[i], "bool", &bv, false));
+	BENCH_READ("ConfigReadBool miss",       ConfigReadBool(cfg, bd->sects[i], "no-such-key", &bv, false));
+
+#undef BENCH_READ
+}
+
+static void BenchMutations(const BenchData *bd)
+{
+	Config *cfg = ConfigNew();
+	char    sect[256], key[256];
+	Bench   b;
+	int     s, k;
+
+	BenchStart(&b, "ConfigAddString");
+	for (s = 0; s < bd->gp.numofsect; ++s) {
+		GenSectName(&bd->gp, s, sect, sizeof(sect));
+		for (k = 0; k < bd->gp.numofkeys; ++k) {
+			GenKeyName(&bd->gp, s, k, key, sizeof(key));
+			ConfigAddString(cfg, sect, key, "value");
+			++b.numofops;
+		}
+	}
+	BenchStop(&b);
+
+	BenchStart(&b, "ConfigRemoveKey");
+	for (s = 0; s < bd->gp.numofsect; ++s) {
+		GenSectName(&bd->gp, s, sect, sizeof(sect));
+		for (k = 0; k < bd->gp.numofkeys; ++k) {
+			GenKeyName(&bd->gp, s, k, key, sizeof(key));
+			ConfigRemoveKey(cfg, sect, key);
+			++b.numofops;
+		}
+	}
+	BenchStop(&b);
+
+	ConfigFree(cfg);
+}
+
+static void BenchPrintFree(const BenchData *bd)
+{
+	Config *cfg = NULL;
+	FILE   *fp;
+	Bench   b;
+
+	if ( (ConfigReadFile(bd->filename, &cfg) != CONFIG_OK) ||
+		 ((fp = fopen("/dev/null", "w")) == NULL) ) {
+		LOG_ERR("cannot load %s", bd->filename);
+		ConfigFree(cfg);
+		return;
+	}
+
+	BenchStart(&b, "ConfigPrint");
+	ConfigPrint(cfg, fp);
+	fflush(fp);
+	b.bytes = ftell(fp) > 0 ? ftell(fp) : bd->filesize;
+	b.numofops = 1;
+	BenchStop(&b);
+	fclose(fp);
+
+	/* per key */
+	BenchStart(&b, "ConfigFree");
+	ConfigFree(cfg);
+	b.numofops = (unsigned long long) bd->gp.numofsect * bd->gp.numofkeys;
+	BenchStop(&b);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * \brief Thread reloading the benchmark config in a loop
+ */
+typedef struct Reloader
+{
+	const BenchData    *bd;
+	int                 stop;
+	Hist                reloads;          /* latency of each reload */
+	pthread_t           thread;
+} Reloader;
+
+static void *ReloadWorker(void *arg)
+{
+	Reloader           *r = arg;
+	Config             *cfg;
+	unsigned long long  t;
+
+	while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+		cfg = NULL;
+		t = NowNs();
+		if (ConfigReadFile(r->bd->filename, &cfg) == CONFIG_OK)
+			ConfigFree(cfg);
+		HistRecord(&r->reloads, NowNs() - t);
+	}
+
+	return NULL;
+}
+
+static void LatencyReport(const char *scenario, const char *op, const Hist *h)
+{
+	printf("%s,%s,%llu,%llu,%llu,%llu,%llu,%llu\n", scenario, op, h->count,
+			h->count ? h->min : 0, HistPercentile(h, 50.0), HistPercentile(h, 99.0),
+			HistPercentile(h, 99.9), h->max);
+}
+
+/*
+ * Records latency of every lookup separately. If flush is given, it is overwritten before
+ * each lookup to evict the config from the caches; the flush itself is not timed.
+ */
+static void LatencyRun(const Config *cfg, const BenchData *bd, const char *scenario, int numoflookups,
+		char *flush, size_t flushsize)
+{
+	static Hist         hint, hstr;
+	char                sbuf[4096];
+	int                 iv;
+	unsigned long long  t;
+	int                 i, n;
+
+	HistInit(&hint);
+	HistInit(&hstr);
+
+	for (i = 0; i < numoflookups; ++i) {
+		n = i % bd->numoflookups;
+
+		if (flush)
+			memset(flush, i, flushsize);
+		t = NowNs();
+		ConfigReadInt(cfg, bd->sects[n], "int", &iv, 0);
+		HistRecord(&hint, NowNs() - t);
+
+		if (flush)
+			memset(flush, i, flushsize);
+		t = NowNs();
+		ConfigReadString(cfg, bd->sects[n], bd->keys[n], sbuf, sizeof(sbuf), "");
+		HistRecord(&hstr, NowNs() - t);
+	}
+
+	LatencyReport(scenario, "ConfigReadInt",    &hint);
+	LatencyReport(scenario, "ConfigReadString", &hstr);
+}
+
+/*
+ * Latency distribution of lookups with hot caches, with cold caches and while another
+ * thread reloads the config file. Output is CSV, one line per scenario and operation;
+ * the reload scenario also reports the reloads done during its lookups.
+ */
+static void BenchLatency(const Config *cfg, const BenchData *bd, int numofcold, int flushmb)
+{
+	static Reloader  r;
+	char            *flush;
+
+	printf("scenario,op,count,min_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+
+	LatencyRun(cfg, bd, "hot", bd->numoflookups, NULL, 0);
+
+	if ((flush = malloc((size_t) flushmb * MB)) != NULL) {
+		LatencyRun(cfg, bd, "cold", numofcold, flush, (size_t) flushmb * MB);
+		free(flush);
+	}
+	else
+		LOG_ERR("cannot allocate %d MB for cache flush", flushmb);
+
+	memset(&r, 0, sizeof(r));
+	r.bd = bd;
+	HistInit(&r.reloads);
+	if (pthread_create(&r.thread, NULL, ReloadWorker, &r) != 0) {
+		LOG_ERR("%s", "cannot start reload thread");
+		return;
+	}
+	LatencyRun(cfg, bd, "reload", bd->numoflookups, NULL, 0);
+	__atomic_store_n(&r.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(r.thread, NULL);
+	LatencyReport("reload", "ConfigReadFile", &r.reloads);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void Usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"   -s <n>        number of sections (default 100)\n"
+		"   -k <n>        keys per section (default 100)\n"
+		"   -K <min:max>  key length range (default 4:24)\n"
+		"   -V <min:max>  value length range (default 1:64)\n"
+		"   -c <ratio>    comment lines per key (default 0.1)\n"
+		"   -S <seed>     random seed (default 1)\n"
+		"   -n <n>        iterations of file reads (default 10)\n"
+		"   -l <n>        number of lookups (default 1000000)\n"
+		"   -g            only write generated config to stdout\n"
+		"   -P            report hardware counters per op (Linux perf_event_open)\n"
+		"   -L            report lookup latency percentiles as CSV\n"
+		"   -C <n>        number of cold cache lookups of -L (default 1000)\n"
+		"   -F <MB>       size of cache flush buffer of -L (default 64)\n", prog);
+}
+
+static int ParseRange(const char *s, int *min, int *max)
+{
+	if (sscanf(s, "%d:%d", min, max) != 2)
+		*max = *min = atoi(s);
+
+	return ((*min > 0) && (*max >= *min)) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchData bd;
+	Config   *cfg = NULL;
+	int       iterations = 10;
+	int       numoflookups = 1000000;
+	bool      genonly = false;
+	bool      latency = false;
+	int       numofcold = 1000;
+	int       flushmb = 64;
+	int       opt;
+
+	memset(&bd, 0, sizeof(bd));
+	GenDefaultParams(&bd.gp);
+
+	while ((opt = getopt(argc, argv, "s:k:K:V:c:S:n:l:gPLC:F:h")) != -1) {
+		switch (opt) {
+			case 's': bd.gp.numofsect = atoi(optarg); break;
+			case 'k': bd.gp.numofkeys = atoi(optarg); break;
+			case 'K': if (ParseRange(optarg, &bd.gp.keylen_min, &bd.gp.keylen_max)) goto usage; break;
+			case 'V': if (ParseRange(optarg, &bd.gp.vallen_min, &bd.gp.vallen_max)) goto usage; break;
+			case 'c': bd.gp.comment_ratio = atof(optarg); break;
+			case 'S': bd.gp.seed = strtoul(optarg, NULL, 10); break;
+			case 'n': iterations = atoi(optarg); break;
+			case 'l': numoflookups = atoi(optarg); break;
+			case 'g': genonly = true; break;
+			case 'P': perfon = true; break;
+			case 'L': latency = true; break;
+			case 'C': numofcold = atoi(optarg); break;
+			case 'F': flushmb = atoi(optarg); break;
+			default:  goto usage;
+		}
+	}
+
+	if ((bd.gp.numofsect <= 0) || (bd.gp.numofkeys <= 0) || (iterations <= 0) || (numoflookups <= 0) ||
+		(numofcold <= 0) || (flushmb <= 0))
+		goto usage;
+
+	if (genonly) {
+		GenWrite(&bd.gp, stdout);
+		return 0;
+	}
+
+	if (BenchDataInit(&bd, numoflookups) != 0) {
+		LOG_ERR("%s", "cannot generate config");
+		return 1;
+	}
+
+	if (latency) {
+		if (ConfigReadFile(bd.filename, &cfg) == CONFIG_OK) {
+			AddTypedKeys(cfg, &bd);
+			BenchLatency(cfg, &bd, numofcold, flushmb);
+			ConfigFree(cfg);
+		}
+		BenchDataFree(&bd);
+		return 0;
+	}
+
+	if (perfon && (PerfOpen() == 0)) {
+		LOG_ERR("%s", "no hardware counters available (perf_event_paranoid, PMU of VM?)");
+		perfon = false;
+	}
+
+	printf("# %d sections x %d keys, key length %d-%d, value length %d-%d, %.2f comments/key, %zu bytes\n",
+			bd.gp.numofsect, bd.gp.numofkeys, bd.gp.keylen_min, bd.gp.keylen_max,
+			bd.gp.vallen_min, bd.gp.vallen_max, bd.gp.comment_ratio, bd.filesize);
+	BenchHeader();
+
+	BenchReadFile(&bd, iterations);
+	BenchRead(&bd, iterations);
+
+	if (ConfigReadFile(bd.filename, &cfg) == CONFIG_OK) {
+		AddTypedKeys(cfg, &bd);
+		BenchReads(cfg, &bd);
+		ConfigFree(cfg);
+	}
+
+	BenchMutations(&bd);
+	BenchPrintFree(&bd);
+
+	BenchDataFree(&bd);
+	PerfClose();
+
+	return 0;
+
+usage:
+	Usage(argv[0]);
+	return 1;
+}
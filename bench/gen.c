@@ -0,0 +1,95 @@
+/*
+ * libconfigini benchmarks - synthetic config generator
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gen.h"
+
+
+static const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-";
+
+
+unsigned int GenRand(unsigned long long *state)
+{
+	/* xorshift64* */
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	return (unsigned int) ((*state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static int GenLength(unsigned long long *state, int min, int max)
+{
+	return (max > min) ? min + (int) (GenRand(state) % (unsigned int) (max - min + 1)) : min;
+}
+
+void GenDefaultParams(GenParams *gp)
+{
+	gp->numofsect     = 100;
+	gp->numofkeys     = 100;
+	gp->keylen_min    = 4;
+	gp->keylen_max    = 24;
+	gp->vallen_min    = 1;
+	gp->vallen_max    = 64;
+	gp->comment_ratio = 0.1;
+	gp->seed          = 1;
+}
+
+void GenSectName(const GenParams *gp, int sect, char *buf, int size)
+{
+	snprintf(buf, size, "section-%d", sect);
+}
+
+/*
+ * Keys are unique by their numeric prefix and padded with characters derived
+ * from (sect, key) to the requested length, so they can be rebuilt without
+ * storing them.
+ */
+void GenKeyName(const GenParams *gp, int sect, int key, char *buf, int size)
+{
+	unsigned long long state = ((unsigned long long) gp->seed << 40) ^ ((unsigned long long) sect << 20) ^ key ^ 1;
+	int                len, n;
+
+	len = GenLength(&state, gp->keylen_min, gp->keylen_max);
+	if (len >= size)
+		len = size - 1;
+
+	n = snprintf(buf, size, "k%d_", key);
+	while (n < len)
+		buf[n++] = charset[GenRand(&state) % 62];
+	buf[n] = '\0';
+}
+
+size_t GenWrite(const GenParams *gp, FILE *stream)
+{
+	unsigned long long state = gp->seed | 1;
+	char               name[256];
+	char               val[4096];
+	size_t             bytes = 0;
+	int                s, k, i, len;
+
+	for (s = 0; s < gp->numofsect; ++s) {
+		GenSectName(gp, s, name, sizeof(name));
+		bytes += fprintf(stream, "\n[%s]\n", name);
+
+		for (k = 0; k < gp->numofkeys; ++k) {
+			if ((GenRand(&state) % 1000) < (unsigned int) (gp->comment_ratio * 1000))
+				bytes += fprintf(stream, "# comment of key %d in section %d\n", k, s);
+
+			len = GenLength(&state, gp->vallen_min, gp->vallen_max);
+			if (len >= (int) sizeof(val))
+				len = sizeof(val) - 1;
+			for (i = 0; i < len; ++i)
+				val[i] = charset[GenRand(&state) % (sizeof(charset) - 1)];
+			val[len] = '\0';
+
+			GenKeyName(gp, s, k, name, sizeof(name));
+			bytes += fprintf(stream, "%s = %s\n", name, val);
+		}
+	}
+
+	return bytes;
+}
@@ -0,0 +1,40 @@
+/*
+ * libconfigini benchmarks - synthetic config generator
+ */
+
+#ifndef BENCH_GEN_H_
+#define BENCH_GEN_H_
+
+#include <stdio.h>
+
+
+/**
+ * \brief Shape of generated configs
+ */
+typedef struct GenParams
+{
+	int          numofsect;      /* number of sections */
+	int          numofkeys;      /* keys per section */
+	int          keylen_min;     /* key length is uniform in [min, max] */
+	int          keylen_max;
+	int          vallen_min;     /* value length is uniform in [min, max] */
+	int          vallen_max;
+	double       comment_ratio;  /* probability of a comment line before each key */
+	unsigned int seed;
+} GenParams;
+
+
+void   GenDefaultParams(GenParams *gp);
+
+/* writes a config to the stream, returns number of bytes written */
+size_t GenWrite        (const GenParams *gp, FILE *stream);
+
+/* name of n'th section and key of the config generated with gp */
+void   GenSectName     (const GenParams *gp, int sect, char *buf, int size);
+void   GenKeyName      (const GenParams *gp, int sect, int key, char *buf, int size);
+
+/* deterministic pseudo random numbers */
+unsigned int GenRand   (unsigned long long *state);
+
+
+#endif /* BENCH_GEN_H_ */
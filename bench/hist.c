@@ -0,0 +1,79 @@
+/*
+ * libconfigini benchmarks - latency histogram
+ */
+
+#include <string.h>
+
+#include "hist.h"
+
+
+#define HIST_HALF_COUNT  (HIST_SUB_COUNT / 2)
+
+
+static int HistIndex(unsigned long long value)
+{
+	int shift;
+
+	if (value < HIST_SUB_COUNT)
+		return (int) value;
+
+	/* keep HIST_SUB_BITS significant bits */
+	shift = 63 - __builtin_clzll(value) - (HIST_SUB_BITS - 1);
+	if (shift > HIST_MAX_SHIFT)
+		return HIST_NUMOFBUCKET - 1;
+
+	return (shift + 1) * HIST_HALF_COUNT + (int) (value >> shift) - HIST_HALF_COUNT;
+}
+
+static unsigned long long HistHighestEquivalent(int index)
+{
+	int shift;
+
+	if (index < HIST_SUB_COUNT)
+		return index;
+
+	shift = index / HIST_HALF_COUNT - 1;
+
+	return ((unsigned long long) (index % HIST_HALF_COUNT + HIST_HALF_COUNT + 1) << shift) - 1;
+}
+
+void HistInit(Hist *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = ~0ULL;
+}
+
+void HistRecord(Hist *h, unsigned long long value)
+{
+	++h->buckets[HistIndex(value)];
+	++h->count;
+
+	if (value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+}
+
+unsigned long long HistPercentile(const Hist *h, double percentile)
+{
+	unsigned long long target, sum = 0;
+	unsigned long long value;
+	int                i;
+
+	if (h->count == 0)
+		return 0;
+
+	target = (unsigned long long) (percentile / 100.0 * h->count + 0.5);
+	if (target < 1)
+		target = 1;
+
+	for (i = 0; i < HIST_NUMOFBUCKET; ++i) {
+		sum += h->buckets[i];
+		if (sum >= target) {
+			value = HistHighestEquivalent(i);
+			return (value < h->max) ? value : h->max;
+		}
+	}
+
+	return h->max;
+}
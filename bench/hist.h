@@ -0,0 +1,35 @@
+/*
+ * libconfigini benchmarks - latency histogram
+ */
+
+#ifndef BENCH_HIST_H_
+#define BENCH_HIST_H_
+
+
+#define HIST_SUB_BITS    7                            /* ~1% precision of recorded values */
+#define HIST_SUB_COUNT   (1 << HIST_SUB_BITS)
+#define HIST_MAX_SHIFT   40                           /* values up to ~2^47 ns */
+#define HIST_NUMOFBUCKET ((HIST_MAX_SHIFT + 2) * (HIST_SUB_COUNT / 2))
+
+
+/**
+ * \brief HDR-style histogram: buckets are linear below HIST_SUB_COUNT and then grow
+ *        logarithmically, each power of two split into HIST_SUB_COUNT / 2 sub buckets
+ */
+typedef struct Hist
+{
+	unsigned long long count;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long buckets[HIST_NUMOFBUCKET];
+} Hist;
+
+
+void               HistInit      (Hist *h);
+void               HistRecord    (Hist *h, unsigned long long value);
+
+/* highest value equivalent to the value at the given percentile (0 - 100) */
+unsigned long long HistPercentile(const Hist *h, double percentile);
+
+
+#endif /* BENCH_HIST_H_ */
@@ -0,0 +1,114 @@
+/*
+ * libconfigini benchmarks - hardware performance counters
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf.h"
+
+
+static int perf_fds[PERF_NUMOFEVENT] = { -1, -1, -1, -1, -1 };
+
+static const char *perf_names[PERF_NUMOFEVENT] = {
+	"cycles",
+	"instructions",
+	"L1d-misses",
+	"LLC-misses",
+	"branch-misses",
+};
+
+
+const char *PerfName(PerfEvent ev)
+{
+	return perf_names[ev];
+}
+
+#ifdef __linux__
+
+static int PerfOpenEvent(unsigned int type, unsigned long long config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size           = sizeof(attr);
+	attr.type           = type;
+	attr.config         = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv     = 1;
+	attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	/* counters are opened separately so a missing event does not disable the others */
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int PerfOpen(void)
+{
+	int i, n = 0;
+
+	perf_fds[PERF_CYCLES]        = PerfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	perf_fds[PERF_INSTRUCTIONS]  = PerfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	perf_fds[PERF_L1D_MISSES]    = PerfOpenEvent(PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_L1D |
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	perf_fds[PERF_LLC_MISSES]    = PerfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	perf_fds[PERF_BRANCH_MISSES] = PerfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+	for (i = 0; i < PERF_NUMOFEVENT; ++i)
+		n += (perf_fds[i] >= 0);
+
+	return n;
+}
+
+void PerfRead(PerfCounters *pc)
+{
+	unsigned long long buf[3];     /* value, time enabled, time running */
+	int                i;
+
+	for (i = 0; i < PERF_NUMOFEVENT; ++i) {
+		pc->value[i] = -1;
+
+		if ( (perf_fds[i] < 0) || (read(perf_fds[i], buf, sizeof(buf)) != sizeof(buf)) )
+			continue;
+
+		/* scale up if the counter was multiplexed with others */
+		if ((buf[2] > 0) && (buf[2] < buf[1]))
+			pc->value[i] = (double) buf[0] * buf[1] / buf[2];
+		else
+			pc->value[i] = (double) buf[0];
+	}
+}
+
+#else  /* !__linux__ */
+
+int PerfOpen(void)
+{
+	return 0;
+}
+
+void PerfRead(PerfCounters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUMOFEVENT; ++i)
+		pc->value[i] = -1;
+}
+
+#endif /* __linux__ */
+
+void PerfClose(void)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUMOFEVENT; ++i) {
+		if (perf_fds[i] >= 0)
+			close(perf_fds[i]);
+		perf_fds[i] = -1;
+	}
+}
@@ -0,0 +1,41 @@
+/*
+ * libconfigini benchmarks - hardware performance counters
+ */
+
+#ifndef BENCH_PERF_H_
+#define BENCH_PERF_H_
+
+
+/**
+ * \brief Counted events
+ */
+typedef enum
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_NUMOFEVENT
+} PerfEvent;
+
+/**
+ * \brief Snapshot of all counters, scaled for multiplexing.
+ *        A counter which cannot be opened reads as -1.
+ */
+typedef struct PerfCounters
+{
+	double value[PERF_NUMOFEVENT];
+} PerfCounters;
+
+
+/* opens counters of the calling thread, returns number of counters opened */
+int         PerfOpen (void);
+void        PerfClose(void);
+
+void        PerfRead (PerfCounters *pc);
+
+const char *PerfName (PerfEvent ev);
+
+
+#endif /* BENCH_PERF_H_ */
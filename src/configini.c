@@ -29,10 +29,55 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <regex.h>
+#include <sys/stat.h>
+
+#ifdef __GLIBC__
+# include <malloc.h>
+# define HAVE_MALLOC_USABLE_SIZE
+#endif
+
+#if defined(__linux__) && defined(__has_include) && !defined(CONFIG_NO_IO_URING)
+# if __has_include(<linux/io_uring.h>)
+#  define HAVE_IO_URING
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <linux/io_uring.h>
+#  include <linux/stat.h>
+#  ifndef AT_EMPTY_PATH
+#   define AT_EMPTY_PATH     0x1000
+#  endif
+# endif
+#endif
+
+/*
+ * USDT probes (provider "configini") for tracers as bpftrace, built with -DCONFIG_USDT:
+ *   read__start(filename, fp), read__done(filename, ret)   ConfigRead(), ConfigReadFile()
+ *   section(name, line), keyval(key, value, line)          each line parsed
+ *   lookup(section, key, ret)                              ConfigRead*() lookups
+ *   add(section, key, value), remove(section, key, ret)    ConfigAddString(), ConfigRemoveKey()
+ * Probes are single nop instructions in the library until a tracer attaches.
+ */
+#ifdef CONFIG_USDT
+# include <sys/sdt.h>
+# define PROBE2(name, a, b)        DTRACE_PROBE2(configini, name, a, b)
+# define PROBE3(name, a, b, c)     DTRACE_PROBE3(configini, name, a, b, c)
+#else
+# define PROBE2(name, a, b)        do { } while (0)
+# define PROBE3(name, a, b, c)     do { } while (0)
+#endif
 
 #include "configini.h"
 #include "queue.h"
@@ -45,6 +90,129 @@
 
 #define CONFIG_INIT_MAGIC    0x12F0ED1
 
+#define HTAB_INIT_SIZE       8      /* initial bucket count of hash indexes (power of 2) */
+#define MAX_THREADS          64     /* upper limit of worker threads for parallel loading */
+#define INCLUDE_DIRECTIVE    "@include"
+#define FILE_BUF_SIZE        16384  /* stdio buffer of files being read */
+#define ASYNC_RING_ENTRIES   64     /* io_uring submission queue size */
+#define ASYNC_READ_MAX       (1U << 30)     /* max bytes of a single io_uring read */
+#define WRITER_BUF_SIZE      (256 * 1024)   /* output buffer of ConfigWriter */
+#define PROFILE_HOT_KEYS     32     /* keys listed as hot by ConfigDumpAccessProfile() */
+#define ARENA_ALIGN          sizeof(void *)
+#define INTERN_INIT_SIZE     64     /* initial bucket count of intern tables (power of 2) */
+#define SCHEMA_VALUE_BUF     128    /* values shorter than this are checked without allocation */
+#define SCHEMA_ERR_SIZE      512    /* max length of schema error messages */
+
+#define KV_KEY_INTERNED      0x01   /* key of the key-value is held by an intern table */
+#define KV_VALUE_INTERNED    0x02   /* value of the key-value is held by an intern table */
+
+#ifdef CLOCK_REALTIME_COARSE
+# define PROFILE_CLOCK       CLOCK_REALTIME_COARSE  /* tick resolution is enough for access times */
+#else
+# define PROFILE_CLOCK       CLOCK_REALTIME
+#endif
+
+
+/**
+ * \brief Memory block which holds sections and key-values laid out by ConfigRelayout().
+ *        Objects placed in it are not freed one by one; the block is freed when the
+ *        last of them is released.
+ */
+typedef struct ConfigArena
+{
+	int    refcnt;                      /* objects placed in the block and not released */
+	size_t size;
+	char   data[];
+} ConfigArena;
+
+/**
+ * \brief String held by an intern table, shared by all key-values with the same contents
+ */
+typedef struct InternStr
+{
+	struct InternStr *hnext;            /* next string in the same hash bucket */
+	struct ConfigIntern *intern;        /* table holding the string */
+	unsigned int hash;                  /* same as StrHash(str) */
+	unsigned int refcnt;                /* key-values pointing to str */
+	size_t len;
+	char str[];
+} InternStr;
+
+/**
+ * \brief Subscription to changes of a key or of keys with a prefix, see ConfigSubscribe()
+ */
+struct ConfigSubscription
+{
+	char *section;
+	char *key;                          /* key, or prefix if prefixlen >= 0 */
+	int prefixlen;                      /* -1 for a single key */
+	unsigned int hash;                  /* index hash, see SubHash() */
+	ConfigChangeCallback callback;
+	void *ctx;
+	int nchanges;                       /* changes since the last notification */
+	bool pending;                       /* linked in pending list of the config */
+	bool ownctx;                        /* ctx is freed with the subscription */
+	struct ConfigSubscription *hnext;   /* next subscription in the same hash bucket */
+	TAILQ_ENTRY(ConfigSubscription) next;
+};
+
+/**
+ * \brief Compiled rule of a key, see ConfigSchemaAddKey()
+ */
+typedef struct SchemaKey
+{
+	char *key;
+	unsigned int hash;                  /* hash of key */
+	ConfigType type;
+	bool required;
+	bool ranged;
+	double min;
+	double max;
+	char **values;                      /* sorted set of allowed values (NULL: any) */
+	int numofvalues;
+	bool has_re;
+	regex_t re;                         /* anchored pattern of the value */
+	struct SchemaKey *hnext;            /* next rule in the same hash bucket */
+	TAILQ_ENTRY(SchemaKey) next;
+} SchemaKey;
+
+/**
+ * \brief Check table of a section
+ */
+typedef struct SchemaSection
+{
+	char *name;
+	unsigned int hash;                  /* hash of name */
+	SchemaKey **htab;
+	unsigned int htabsize;
+	int numofkeys;
+	struct SchemaSection *hnext;        /* next section in the same hash bucket */
+	TAILQ_HEAD(, SchemaKey) key_list;
+	TAILQ_ENTRY(SchemaSection) next;
+} SchemaSection;
+
+/**
+ * \brief Validation schema, see ConfigSchemaNew()
+ */
+struct ConfigSchema
+{
+	SchemaSection **htab;
+	unsigned int htabsize;
+	int numofsects;
+	TAILQ_HEAD(, SchemaSection) sect_list;
+};
+
+/**
+ * \brief Intern table, see ConfigInternNew()
+ */
+struct ConfigIntern
+{
+	pthread_mutex_t lock;               /* tables are shared by configs read in parallel */
+	InternStr **htab;
+	unsigned int htabsize;
+	int refcnt;                         /* handle and configs using the table */
+	ConfigInternStats stats;
+};
 
 /**
  * \brief Configuration key-value
@@ -53,6 +221,14 @@ typedef struct ConfigKeyValue
 {
 	char *key;
 	char *value;
+	unsigned int hash;                  /* hash of key */
+	unsigned int vhash;                 /* hash of value */
+	unsigned long long digest;          /* 64-bit hash of key and value, see KeyValDigest() */
+	unsigned int interned;              /* KV_KEY_INTERNED, KV_VALUE_INTERNED */
+	unsigned int reads;                 /* sampled read count of access profiler */
+	unsigned long long atime;           /* time of last sampled read (ns since epoch) */
+	ConfigArena *arena;                 /* block holding kv and its strings (NULL: heap) */
+	struct ConfigKeyValue *hnext;       /* next key-value in the same hash bucket */
 	TAILQ_ENTRY(ConfigKeyValue) next;
 } ConfigKeyValue;
 
@@ -63,6 +239,14 @@ typedef struct ConfigSection
 {
 	char *name;
 	int numofkv;
+	unsigned int hash;                  /* hash of name */
+	unsigned long long digest;          /* sum of digests of all key-values (order independent) */
+	struct ConfigSection *hnext;        /* next section in the same hash bucket */
+	ConfigKeyValue **kv_htab;           /* key index (NULL means linear search) */
+	unsigned int kv_htabsize;
+	ConfigArena *arena;                 /* block holding sect, name and index (NULL: heap) */
+	struct Config *cfg;                 /* config the section belongs to */
+	ConfigMemStats mem;                 /* memory used by the section and its key-values */
 	TAILQ_HEAD(, ConfigKeyValue) kv_list;
 	TAILQ_ENTRY(ConfigSection) next;
 } ConfigSection;
@@ -78,11 +262,58 @@ struct Config
 	char *false_str;
 	int  initnum;
 	int  numofsect;
+	ConfigSection **sect_htab;          /* section index (NULL means linear search) */
+	unsigned int sect_htabsize;
+	int  refcnt;                        /* references dropped by ConfigRelease() */
+	ConfigStats *stats;                 /* runtime statistics (NULL if disabled) */
+	unsigned int prof_period;           /* access profiler samples every n'th read (0: off) */
+	ConfigTiming *timing;               /* phase times of the read in progress (NULL if off) */
+	ConfigMemStats mem;                 /* memory used by the whole config */
+	struct ConfigIntern *intern;        /* table of keys and values (NULL: not interned) */
+	struct ConfigSubscription **sub_htab; /* subscription index (NULL: no subscriptions) */
+	unsigned int sub_htabsize;
+	int  numofsubs;
+	int  txn;                           /* nesting of open updates, see ConfigBeginUpdate() */
+	TAILQ_HEAD(, ConfigSubscription) sub_pending;
+	const struct ConfigSchema *schema;  /* checks of added keys (NULL: none) */
+	char *schema_err;                   /* last schema violation */
+	bool nested;                        /* read on behalf of another config, see ConfigCopySettings() */
+	struct SharedConfig *shared;        /* cache entry if opened by ConfigOpenShared() */
 	TAILQ_HEAD(, ConfigSection) sect_list;
 };
 
+/* settings of ConfigParseStream() when no config handle is given */
+static const Config DefaultSettings = {
+	.comment_chars = COMMENT_CHARS,
+	.keyval_sep    = KEYVAL_SEP,
+	.true_str      = STR_TRUE,
+	.false_str     = STR_FALSE,
+	.initnum       = CONFIG_INIT_MAGIC,
+};
+
+
 
 
+/* statistics are updated with relaxed atomics since const handles may be read concurrently */
+#define STAT_ADD(cfg, field, n)												\
+	do {																	\
+		if ((cfg)->stats)													\
+			__atomic_add_fetch(&(cfg)->stats->field, (n), __ATOMIC_RELAXED);\
+	} while (0)
+
+#define STAT_INC(cfg, field)	STAT_ADD(cfg, field, 1)
+
+/* phases are timed only while a read with timing is in progress on the handle */
+#define TIMING_ADD(cfg, field, start)										\
+	do {																	\
+		if ((cfg)->timing)													\
+			__atomic_add_fetch(&(cfg)->timing->field, NowNs() - (start),	\
+					__ATOMIC_RELAXED);										\
+	} while (0)
+
+/* reads of this thread, drives sampling of the access profiler */
+static __thread unsigned int prof_tick;
+
 
 static int StrSafeCopy(char *dst, const char *src, int size)
 {
@@ -121,105 +352,134 @@ static bool StrIsTypeOfFalse(const char *s)
 	return false;
 }
 
+static unsigned long long NowNs(void)
+{
+	struct timespec ts;
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-const char *ConfigRetToString(ConfigRet ret)
+static unsigned long long TimingStart(const Config *cfg)
 {
-	switch(ret) {
-		case CONFIG_OK:                return "OK";
-		case CONFIG_ERR_FILE:          return "File IO error";
-		case CONFIG_ERR_NO_SECTION:    return "No section";
-		case CONFIG_ERR_NO_KEY:        return "No key";
-		case CONFIG_ERR_MEMALLOC:      return "Memory allocation failed";
-		case CONFIG_ERR_INVALID_PARAM: return "Invalid parameter";
-		case CONFIG_ERR_INVALID_VALUE: return "Invalid value";
-		case CONFIG_ERR_PARSING:       return "Parse error";
-		default:                       return NULL;
-	}
+	return cfg->timing ? NowNs() : 0;
 }
 
-/**
- * \brief              ConfigSetCommentCharset() sets comment characters
- *
- * \param cfg          config handle
- * \param comment_ch   charaters to consider as comments
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-ConfigRet ConfigSetCommentCharset(Config *cfg, const char *comment_ch)
+/* FNV-1a; NULL (flat section name) hashes to 0 */
+static unsigned int StrHash(const char *s)
 {
-	char *p;
+	unsigned int h = 2166136261U;
 
-	if (!cfg || !comment_ch)
-		return CONFIG_ERR_INVALID_PARAM;
+	if (!s)
+		return 0;
 
-	if ((p = strdup(comment_ch)) == NULL)
-		return CONFIG_ERR_MEMALLOC;
+	while (*s) {
+		h ^= (unsigned char) *s++;
+		h *= 16777619U;
+	}
 
-	if (cfg->comment_chars)
-		free(cfg->comment_chars);
-	cfg->comment_chars = p;
+	return h;
+}
 
-	return CONFIG_OK;
+static bool StrEqual(const char *s1, const char *s2)
+{
+	if (!s1 || !s2)
+		return (s1 == s2);
+	return !strcmp(s1, s2);
 }
 
-/**
- * \brief              ConfigSetCommentCharset() sets comment characters
- *
- * \param cfg          config handle
- * \param ch           charater to consider as key-value seperator
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-ConfigRet ConfigSetKeyValSepChar(Config *cfg, char ch)
+/* whether key-values have the same value, interned values are compared by pointer */
+static bool KeyValSameValue(const ConfigKeyValue *kv1, const ConfigKeyValue *kv2)
 {
-	if (!cfg)
-		return CONFIG_ERR_INVALID_PARAM;
+	return ( (kv1->vhash == kv2->vhash) &&
+			 ((kv1->value == kv2->value) || !strcmp(kv1->value, kv2->value)) );
+}
 
-	cfg->keyval_sep = ch;
+/* finalizer of splitmix64, spreads the bits of x over the result */
+static unsigned long long Mix64(unsigned long long x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	x ^= x >> 31;
 
-	return CONFIG_OK;
+	return x;
 }
 
-/**
- * \brief              ConfigSetCommentCharset() sets comment characters
- *
- * \param cfg          config handle
- * \param true_str     string value of boolean true (must be one of these: "true", "yes", "1")
- * \param false_str    string value of boolean false (must be one of these: "false", "no", "0")
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+/*
+ * 64-bit hash of a key-value, the contribution to its section digest. It is computed once
+ * when the value is set, so sections compare in O(1) and only differ by chance (2^-64)
  */
-ConfigRet ConfigSetBoolString(Config *cfg, const char *true_str, const char *false_str)
+static unsigned long long KeyValDigest(const char *key, const char *value)
 {
-	char *t, *f;
+	unsigned long long h = 14695981039346656037ULL;
 
-	if ( !cfg ||
-		 !true_str || !*true_str || !StrIsTypeOfTrue(true_str) ||
-		 !false_str || !*false_str || !StrIsTypeOfFalse(false_str) )
-		return CONFIG_ERR_INVALID_PARAM;
+	for (; *key; ++key) {
+		h ^= (unsigned char) *key;
+		h *= 1099511628211ULL;
+	}
 
-	if ((t = strdup(true_str)) == NULL)
-		return CONFIG_ERR_MEMALLOC;
+	/* separates key from value */
+	h = Mix64(h);
 
-	if ((f = strdup(false_str)) == NULL) {
-		free(t);
-		return CONFIG_ERR_MEMALLOC;
+	for (; *value; ++value) {
+		h ^= (unsigned char) *value;
+		h *= 1099511628211ULL;
 	}
 
-	if (cfg->true_str)
-		free(cfg->true_str);
-	if (cfg->false_str)
-		free(cfg->false_str);
+	return Mix64(h);
+}
 
-	cfg->true_str = t;
-	cfg->false_str = f;
 
-	return CONFIG_OK;
+/*
+ * Minimal thread pool: every worker (and the calling thread) takes the next
+ * unprocessed job index until all jobs are done. If threads cannot be created
+ * the caller simply processes the remaining jobs itself.
+ */
+typedef struct ParallelJobs
+{
+	void (*func)(void *arg, int idx);
+	void *arg;
+	int   numofjobs;
+	int   nextjob;
+} ParallelJobs;
+
+static void *ParallelWorker(void *p)
+{
+	ParallelJobs *jobs = p;
+	int idx;
+
+	while ((idx = __atomic_fetch_add(&jobs->nextjob, 1, __ATOMIC_RELAXED)) < jobs->numofjobs)
+		jobs->func(jobs->arg, idx);
+
+	return NULL;
+}
+
+static void RunParallel(int numofjobs, int nthreads, void (*func)(void *arg, int idx), void *arg)
+{
+	ParallelJobs jobs = { func, arg, numofjobs, 0 };
+	pthread_t    tids[MAX_THREADS];
+	int          i, n = 0;
+
+	if (nthreads <= 0)
+		nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > numofjobs)
+		nthreads = numofjobs;
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	/* calling thread is one of the workers */
+	for (i = 1; i < nthreads; ++i) {
+		if (pthread_create(&tids[n], NULL, ParallelWorker, &jobs) == 0)
+			++n;
+	}
+
+	ParallelWorker(&jobs);
+
+	for (i = 0; i < n; ++i)
+		pthread_join(tids[i], NULL);
 }
 
 
@@ -228,118 +488,817 @@ ConfigRet ConfigSetBoolString(Config *cfg, const char *true_str, const char *fal
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-/**
- * \brief              ConfigGetSection() gets the requested section
- *
- * \param cfg          config handle to search in
- * \param section      section name to search for
- * \param sect         pointer to ConfigSection* searched for to save
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-static ConfigRet ConfigGetSection(const Config *cfg, const char *section, ConfigSection **sect)
+/* whether p points into the arena (strings and indexes may be replaced by heap copies) */
+static bool ArenaOwns(const ConfigArena *arena, const void *p)
 {
-	if (!cfg || !sect)
-		return CONFIG_ERR_INVALID_PARAM;
+	return ( arena && ((const char *) p >= arena->data) &&
+			 ((const char *) p < arena->data + arena->size) );
+}
 
-	TAILQ_FOREACH(*sect, &cfg->sect_list, next) {
-		if ( (section && (*sect)->name && !strcmp((*sect)->name, section)) ||
-			 (!section && !(*sect)->name) ) {
-			return CONFIG_OK;
-		}
-	}
+static void ArenaRelease(ConfigArena *arena)
+{
+	if (__atomic_sub_fetch(&arena->refcnt, 1, __ATOMIC_ACQ_REL) == 0)
+		free(arena);
+}
 
-	return CONFIG_ERR_NO_SECTION;
+static void InternDestroy(ConfigIntern *intern)
+{
+	pthread_mutex_destroy(&intern->lock);
+	free(intern->htab);
+	free(intern);
 }
 
-/**
- * \brief              Checks whether section exists
- *
- * \param cfg          config handle to search in
- * \param section      section name to search for
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-bool ConfigHasSection(const Config *cfg, const char *section)
+/* drops a reference of the table, which is freed when no handle, config or string uses it */
+static void InternUnref(ConfigIntern *intern)
 {
-	ConfigSection *sect = NULL;
+	bool unused;
 
-	return ( (ConfigGetSection(cfg, section, &sect) == CONFIG_OK) ? true : false );
+	pthread_mutex_lock(&intern->lock);
+	unused = (--intern->refcnt == 0) && (intern->stats.strings == 0);
+	pthread_mutex_unlock(&intern->lock);
+
+	if (unused)
+		InternDestroy(intern);
 }
 
-/**
- * \brief              ConfigGetKeyValue() gets the ConfigKeyValue *
- *
- * \param cfg          config handle
- * \param sect         section to search in
- * \param key          key to search for
- * \param kv           pointer to ConfigKeyValue* searched for to save
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-static ConfigRet ConfigGetKeyValue(const Config *cfg, ConfigSection *sect, const char *key,
-		ConfigKeyValue **kv)
+/* drops a reference of an interned string */
+static void InternRelease(char *s)
 {
-	if (!sect || !key || !kv)
-		return CONFIG_ERR_INVALID_PARAM;
+	InternStr    *is     = (InternStr *) (s - offsetof(InternStr, str));
+	ConfigIntern *intern = is->intern;
+	InternStr   **pp;
+	bool          unused = false;
 
-	TAILQ_FOREACH(*kv, &sect->kv_list, next) {
-		if (!strcmp((*kv)->key, key))
-			return CONFIG_OK;
+	pthread_mutex_lock(&intern->lock);
+
+	--intern->stats.refs;
+	if (--is->refcnt > 0) {
+		intern->stats.saved -= is->len + 1;
+	}
+	else {
+		for (pp = &intern->htab[is->hash & (intern->htabsize - 1)]; *pp != is; pp = &(*pp)->hnext)
+			;
+		*pp = is->hnext;
+		--intern->stats.strings;
+		intern->stats.bytes -= is->len + 1;
+		unused = (intern->refcnt == 0) && (intern->stats.strings == 0);
+		free(is);
 	}
 
-	return CONFIG_ERR_NO_KEY;
+	pthread_mutex_unlock(&intern->lock);
+
+	if (unused)
+		InternDestroy(intern);
 }
 
-/**
- * \brief            ConfigGetSectionCount() gets number of sections
- *
- * \param cfg        config handle to search in
- *
- * \return           Returns number of sections on success, -1 on failure.
- */
-int ConfigGetSectionCount(const Config *cfg)
+static void KeyValFreeValue(ConfigKeyValue *kv)
 {
-	if (!cfg)
-		return -1;
+	if (kv->interned & KV_VALUE_INTERNED)
+		InternRelease(kv->value);
+	else if (!ArenaOwns(kv->arena, kv->value))
+		free(kv->value);
+	kv->value = NULL;
+	kv->interned &= ~KV_VALUE_INTERNED;
+}
 
-	return (TAILQ_FIRST(&cfg->sect_list)->numofkv > 0 ? cfg->numofsect : cfg->numofsect - 1);
+static void KeyValFree(ConfigKeyValue *kv)
+{
+	if (kv->interned & KV_KEY_INTERNED)
+		InternRelease(kv->key);
+	else if (!ArenaOwns(kv->arena, kv->key))
+		free(kv->key);
+	KeyValFreeValue(kv);
+
+	if (kv->arena)
+		ArenaRelease(kv->arena);
+	else
+		free(kv);
 }
 
-/**
- * \brief            ConfigGetKeyCount() gets number of keys
- *
- * \param cfg        config handle to search in
- * \param section    section name to search for
- *
- * \return           Returns number of keys on success, -1 on failure.
+static void SectFree(ConfigSection *sect)
+{
+	if (!ArenaOwns(sect->arena, sect->kv_htab))
+		free(sect->kv_htab);
+	if (!ArenaOwns(sect->arena, sect->name))
+		free(sect->name);
+
+	if (sect->arena)
+		ArenaRelease(sect->arena);
+	else
+		free(sect);
+}
+
+/*
+ * Memory usage is kept up to date on every allocation and free of config storage.
+ * Allocations are accounted to their section and its config, or to cfg only if sect is NULL.
+ * Objects in arenas have no allocator slack. Interned strings belong to their intern table.
  */
-int ConfigGetKeyCount(const Config *cfg, const char *section)
+static void MemAccount(Config *cfg, ConfigSection *sect, size_t field, const ConfigArena *arena,
+		const void *p, size_t size, int sign)
 {
-	ConfigSection *sect = NULL;
+	ConfigMemStats *m[2];
+	size_t          usable = size;
+	int             i;
 
-	if (!cfg)
-		return -1;
+	if (!p)
+		return;
 
-	if (ConfigGetSection(cfg, section, &sect) != CONFIG_OK)
-		return -1;
+#ifdef HAVE_MALLOC_USABLE_SIZE
+	if (!ArenaOwns(arena, p))
+		usable = malloc_usable_size((void *) p);
+#endif
 
-	return sect->numofkv;
+	m[0] = sect ? &sect->mem : NULL;
+	m[1] = sect ? &sect->cfg->mem : &cfg->mem;
+
+	for (i = 0; i < 2; ++i) {
+		if (!m[i])
+			continue;
+		if (sign > 0) {
+			*(size_t *) ((char *) m[i] + field) += size;
+			m[i]->slack += usable - size;
+			m[i]->total += usable;
+		}
+		else {
+			*(size_t *) ((char *) m[i] + field) -= size;
+			m[i]->slack -= usable - size;
+			m[i]->total -= usable;
+		}
+	}
 }
 
+static void MemValue(ConfigSection *sect, const ConfigKeyValue *kv, int sign)
+{
+	if (kv->value && !(kv->interned & KV_VALUE_INTERNED))
+		MemAccount(NULL, sect, offsetof(ConfigMemStats, values), kv->arena, kv->value,
+				strlen(kv->value) + 1, sign);
+}
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
+static void MemKeyVal(ConfigSection *sect, const ConfigKeyValue *kv, int sign)
+{
+	MemAccount(NULL, sect, offsetof(ConfigMemStats, nodes), kv->arena, kv, sizeof(ConfigKeyValue), sign);
+	if (!(kv->interned & KV_KEY_INTERNED))
+		MemAccount(NULL, sect, offsetof(ConfigMemStats, keys), kv->arena, kv->key,
+				strlen(kv->key) + 1, sign);
+	MemValue(sect, kv, sign);
+}
 
+/* the section struct, its name and key index */
+static void MemSect(ConfigSection *sect, int sign)
+{
+	MemAccount(NULL, sect, offsetof(ConfigMemStats, nodes), sect->arena, sect, sizeof(ConfigSection), sign);
+	if (sect->name)
+		MemAccount(NULL, sect, offsetof(ConfigMemStats, keys), sect->arena, sect->name,
+				strlen(sect->name) + 1, sign);
+	MemAccount(NULL, sect, offsetof(ConfigMemStats, indexes), sect->arena, sect->kv_htab,
+			sect->kv_htabsize * sizeof(ConfigKeyValue *), sign);
+}
 
-/**
- * \brief              ConfigReadString() reads a string value from the cfg.
- *                     If any error occurs default value is copied to 'value' buffer and
- *                     returns reason. If key is optional and does not exists in config,
- *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
- *
- * \param cfg          config handle
+/* recomputes memory usage of cfg and all its sections */
+static void MemRecount(Config *cfg)
+{
+	ConfigSection  *sect;
+	ConfigKeyValue *kv;
+
+	memset(&cfg->mem, 0, sizeof(ConfigMemStats));
+	MemAccount(cfg, NULL, offsetof(ConfigMemStats, nodes), NULL, cfg, sizeof(Config), 1);
+	MemAccount(cfg, NULL, offsetof(ConfigMemStats, indexes), NULL, cfg->sect_htab,
+			cfg->sect_htabsize * sizeof(ConfigSection *), 1);
+
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		memset(&sect->mem, 0, sizeof(ConfigMemStats));
+		MemSect(sect, 1);
+		TAILQ_FOREACH(kv, &sect->kv_list, next) {
+			MemKeyVal(sect, kv, 1);
+		}
+	}
+}
+
+/* allocators of config storage, counted in statistics of cfg */
+static void *CfgMalloc(const Config *cfg, size_t size)
+{
+	unsigned long long  t = TimingStart(cfg);
+	void               *p;
+
+	STAT_INC(cfg, allocs);
+	STAT_ADD(cfg, alloc_bytes, size);
+
+	p = malloc(size);
+	TIMING_ADD(cfg, alloc_ns, t);
+
+	return p;
+}
+
+static void *CfgCalloc(const Config *cfg, size_t nmemb, size_t size)
+{
+	unsigned long long  t = TimingStart(cfg);
+	void               *p;
+
+	STAT_INC(cfg, allocs);
+	STAT_ADD(cfg, alloc_bytes, nmemb * size);
+
+	p = calloc(nmemb, size);
+	TIMING_ADD(cfg, alloc_ns, t);
+
+	return p;
+}
+
+static char *CfgStrdup(const Config *cfg, const char *s)
+{
+	unsigned long long  t = TimingStart(cfg);
+	char               *p;
+
+	STAT_INC(cfg, allocs);
+	STAT_ADD(cfg, alloc_bytes, strlen(s) + 1);
+
+	p = strdup(s);
+	TIMING_ADD(cfg, alloc_ns, t);
+
+	return p;
+}
+
+/* doubles bucket count of the table, called with the table locked */
+static void InternGrow(ConfigIntern *intern)
+{
+	InternStr    **htab, *is, *t_is;
+	unsigned int   size = intern->htabsize * 2;
+	unsigned int   i;
+
+	if ((htab = calloc(size, sizeof(InternStr *))) == NULL)
+		return;
+
+	for (i = 0; i < intern->htabsize; ++i) {
+		for (is = intern->htab[i]; is; is = t_is) {
+			t_is = is->hnext;
+			is->hnext = htab[is->hash & (size - 1)];
+			htab[is->hash & (size - 1)] = is;
+		}
+	}
+
+	free(intern->htab);
+	intern->htab = htab;
+	intern->htabsize = size;
+}
+
+/*
+ * Gets a reference of the string s[0..len) from the intern table of cfg, which is added
+ * if not present yet. The hash of the string is saved to hash. Returns NULL on failure.
+ */
+static char *InternGet(const Config *cfg, const char *s, size_t len, unsigned int *hash)
+{
+	ConfigIntern  *intern = cfg->intern;
+	InternStr     *is;
+	unsigned int   h = 2166136261U;
+	size_t         i;
+
+	for (i = 0; i < len; ++i) {
+		h ^= (unsigned char) s[i];
+		h *= 16777619U;
+	}
+	*hash = h;
+
+	pthread_mutex_lock(&intern->lock);
+
+	for (is = intern->htab[h & (intern->htabsize - 1)]; is; is = is->hnext) {
+		if ((is->hash == h) && (is->len == len) && !memcmp(is->str, s, len)) {
+			++is->refcnt;
+			++intern->stats.refs;
+			intern->stats.saved += len + 1;
+			pthread_mutex_unlock(&intern->lock);
+			return is->str;
+		}
+	}
+
+	if ((is = CfgMalloc(cfg, sizeof(InternStr) + len + 1)) != NULL) {
+		memcpy(is->str, s, len);
+		is->str[len] = '\0';
+		is->intern = intern;
+		is->hash   = h;
+		is->refcnt = 1;
+		is->len    = len;
+		is->hnext  = intern->htab[h & (intern->htabsize - 1)];
+		intern->htab[h & (intern->htabsize - 1)] = is;
+
+		++intern->stats.refs;
+		intern->stats.bytes += len + 1;
+		if (++intern->stats.strings > intern->htabsize)
+			InternGrow(intern);
+	}
+
+	pthread_mutex_unlock(&intern->lock);
+
+	return is ? is->str : NULL;
+}
+
+
+/*
+ * Sections and key-values are kept in insertion order in TAILQ lists and additionally
+ * chained into power-of-2 sized hash indexes for lookups. If an index cannot be
+ * allocated, lookups fall back to walking the list, so indexing never fails.
+ */
+
+static ConfigRet SectIndexRebuild(Config *cfg, unsigned int size)
+{
+	ConfigSection **htab, *sect;
+
+	if ((htab = CfgCalloc(cfg, size, sizeof(ConfigSection *))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		sect->hnext = htab[sect->hash & (size - 1)];
+		htab[sect->hash & (size - 1)] = sect;
+	}
+
+	MemAccount(cfg, NULL, offsetof(ConfigMemStats, indexes), NULL, htab, size * sizeof(ConfigSection *), 1);
+	MemAccount(cfg, NULL, offsetof(ConfigMemStats, indexes), NULL, cfg->sect_htab,
+			cfg->sect_htabsize * sizeof(ConfigSection *), -1);
+	free(cfg->sect_htab);
+	cfg->sect_htab = htab;
+	cfg->sect_htabsize = size;
+
+	return CONFIG_OK;
+}
+
+/* sect must already be in sect_list */
+static void SectIndexInsert(Config *cfg, ConfigSection *sect)
+{
+	ConfigSection **b;
+
+	/* a rebuild links every listed section; if it fails keep chaining into the old buckets */
+	if ( (!cfg->sect_htab || ((unsigned int) cfg->numofsect > cfg->sect_htabsize)) &&
+		 (SectIndexRebuild(cfg, cfg->sect_htab ? cfg->sect_htabsize * 2 : HTAB_INIT_SIZE) == CONFIG_OK) )
+		return;
+
+	if (!cfg->sect_htab)
+		return;
+
+	b = &cfg->sect_htab[sect->hash & (cfg->sect_htabsize - 1)];
+	sect->hnext = *b;
+	*b = sect;
+}
+
+static void SectIndexRemove(Config *cfg, ConfigSection *sect)
+{
+	ConfigSection **b;
+
+	if (!cfg->sect_htab)
+		return;
+
+	for (b = &cfg->sect_htab[sect->hash & (cfg->sect_htabsize - 1)]; *b; b = &(*b)->hnext) {
+		if (*b == sect) {
+			*b = sect->hnext;
+			break;
+		}
+	}
+}
+
+static ConfigRet KeyValIndexRebuild(const Config *cfg, ConfigSection *sect, unsigned int size)
+{
+	ConfigKeyValue **htab, *kv;
+
+	if ((htab = CfgCalloc(cfg, size, sizeof(ConfigKeyValue *))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	TAILQ_FOREACH(kv, &sect->kv_list, next) {
+		kv->hnext = htab[kv->hash & (size - 1)];
+		htab[kv->hash & (size - 1)] = kv;
+	}
+
+	MemAccount(NULL, sect, offsetof(ConfigMemStats, indexes), NULL, htab, size * sizeof(ConfigKeyValue *), 1);
+	MemAccount(NULL, sect, offsetof(ConfigMemStats, indexes), sect->arena, sect->kv_htab,
+			sect->kv_htabsize * sizeof(ConfigKeyValue *), -1);
+	if (!ArenaOwns(sect->arena, sect->kv_htab))
+		free(sect->kv_htab);
+	sect->kv_htab = htab;
+	sect->kv_htabsize = size;
+
+	return CONFIG_OK;
+}
+
+/* kv must already be in kv_list */
+static void KeyValIndexInsert(const Config *cfg, ConfigSection *sect, ConfigKeyValue *kv)
+{
+	ConfigKeyValue **b;
+
+	/* a rebuild links every listed key; if it fails keep chaining into the old buckets */
+	if ( (!sect->kv_htab || ((unsigned int) sect->numofkv > sect->kv_htabsize)) &&
+		 (KeyValIndexRebuild(cfg, sect, sect->kv_htab ? sect->kv_htabsize * 2 : HTAB_INIT_SIZE) == CONFIG_OK) )
+		return;
+
+	if (!sect->kv_htab)
+		return;
+
+	b = &sect->kv_htab[kv->hash & (sect->kv_htabsize - 1)];
+	kv->hnext = *b;
+	*b = kv;
+}
+
+static void KeyValIndexRemove(ConfigSection *sect, ConfigKeyValue *kv)
+{
+	ConfigKeyValue **b;
+
+	if (!sect->kv_htab)
+		return;
+
+	for (b = &sect->kv_htab[kv->hash & (sect->kv_htabsize - 1)]; *b; b = &(*b)->hnext) {
+		if (*b == kv) {
+			*b = kv->hnext;
+			break;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+const char *ConfigRetToString(ConfigRet ret)
+{
+	switch(ret) {
+		case CONFIG_OK:                return "OK";
+		case CONFIG_ERR_FILE:          return "File IO error";
+		case CONFIG_ERR_NO_SECTION:    return "No section";
+		case CONFIG_ERR_NO_KEY:        return "No key";
+		case CONFIG_ERR_MEMALLOC:      return "Memory allocation failed";
+		case CONFIG_ERR_INVALID_PARAM: return "Invalid parameter";
+		case CONFIG_ERR_INVALID_VALUE: return "Invalid value";
+		case CONFIG_ERR_PARSING:       return "Parse error";
+		case CONFIG_ERR_CONFLICT:      return "Key conflict";
+		default:                       return NULL;
+	}
+}
+
+/**
+ * \brief              ConfigSetCommentCharset() sets comment characters
+ *
+ * \param cfg          config handle
+ * \param comment_ch   charaters to consider as comments
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigSetCommentCharset(Config *cfg, const char *comment_ch)
+{
+	char *p;
+
+	if (!cfg || !comment_ch)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((p = strdup(comment_ch)) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	if (cfg->comment_chars)
+		free(cfg->comment_chars);
+	cfg->comment_chars = p;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigSetCommentCharset() sets comment characters
+ *
+ * \param cfg          config handle
+ * \param ch           charater to consider as key-value seperator
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigSetKeyValSepChar(Config *cfg, char ch)
+{
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	cfg->keyval_sep = ch;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigSetCommentCharset() sets comment characters
+ *
+ * \param cfg          config handle
+ * \param true_str     string value of boolean true (must be one of these: "true", "yes", "1")
+ * \param false_str    string value of boolean false (must be one of these: "false", "no", "0")
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigSetBoolString(Config *cfg, const char *true_str, const char *false_str)
+{
+	char *t, *f;
+
+	if ( !cfg ||
+		 !true_str || !*true_str || !StrIsTypeOfTrue(true_str) ||
+		 !false_str || !*false_str || !StrIsTypeOfFalse(false_str) )
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((t = strdup(true_str)) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	if ((f = strdup(false_str)) == NULL) {
+		free(t);
+		return CONFIG_ERR_MEMALLOC;
+	}
+
+	if (cfg->true_str)
+		free(cfg->true_str);
+	if (cfg->false_str)
+		free(cfg->false_str);
+
+	cfg->true_str = t;
+	cfg->false_str = f;
+
+	return CONFIG_OK;
+}
+
+/* copies parsing & printing settings of src to dst */
+static ConfigRet ConfigCopySettings(Config *dst, const Config *src)
+{
+	ConfigRet ret;
+
+	if ((ret = ConfigSetCommentCharset(dst, src->comment_chars)) != CONFIG_OK)
+		return ret;
+	if ((ret = ConfigSetBoolString(dst, src->true_str, src->false_str)) != CONFIG_OK)
+		return ret;
+
+	/* includes read on behalf of src add their phase times to the same report */
+	dst->timing = src->timing;
+
+	if (src->stats && !dst->stats && ((ret = ConfigEnableStats(dst, true)) != CONFIG_OK))
+		return ret;
+
+	/* strings of configs merged into src are interned in the same table */
+	if (src->intern && ((ret = ConfigSetIntern(dst, src->intern)) != CONFIG_OK))
+		return ret;
+
+	/* keys are checked while dst is read, required keys once they are merged into src */
+	dst->schema = src->schema;
+	dst->nested = true;
+
+	return ConfigSetKeyValSepChar(dst, src->keyval_sep);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/* searches section, number of sections compared is added to ncmp */
+static inline ConfigRet FindSection(const Config *cfg, const char *section, ConfigSection **sect,
+		unsigned int *ncmp)
+{
+	unsigned int h;
+
+	if (cfg->sect_htab) {
+		h = StrHash(section);
+		for (*sect = cfg->sect_htab[h & (cfg->sect_htabsize - 1)]; *sect; *sect = (*sect)->hnext) {
+			++*ncmp;
+			if (((*sect)->hash == h) && StrEqual((*sect)->name, section))
+				return CONFIG_OK;
+		}
+		return CONFIG_ERR_NO_SECTION;
+	}
+
+	TAILQ_FOREACH(*sect, &cfg->sect_list, next) {
+		++*ncmp;
+		if (StrEqual((*sect)->name, section))
+			return CONFIG_OK;
+	}
+
+	return CONFIG_ERR_NO_SECTION;
+}
+
+/* searches key in section, number of keys compared is added to ncmp */
+static inline ConfigRet FindKeyValue(ConfigSection *sect, const char *key, ConfigKeyValue **kv,
+		unsigned int *ncmp)
+{
+	unsigned int h;
+
+	if (sect->kv_htab) {
+		h = StrHash(key);
+		for (*kv = sect->kv_htab[h & (sect->kv_htabsize - 1)]; *kv; *kv = (*kv)->hnext) {
+			++*ncmp;
+			if (((*kv)->hash == h) && (((*kv)->key == key) || !strcmp((*kv)->key, key)))
+				return CONFIG_OK;
+		}
+		return CONFIG_ERR_NO_KEY;
+	}
+
+	TAILQ_FOREACH(*kv, &sect->kv_list, next) {
+		++*ncmp;
+		if (((*kv)->key == key) || !strcmp((*kv)->key, key))
+			return CONFIG_OK;
+	}
+
+	return CONFIG_ERR_NO_KEY;
+}
+
+/**
+ * \brief              ConfigGetSection() gets the requested section
+ *
+ * \param cfg          config handle to search in
+ * \param section      section name to search for
+ * \param sect         pointer to ConfigSection* searched for to save
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+static ConfigRet ConfigGetSection(const Config *cfg, const char *section, ConfigSection **sect)
+{
+	unsigned int ncmp = 0;
+
+	if (!cfg || !sect)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	return FindSection(cfg, section, sect, &ncmp);
+}
+
+/**
+ * \brief              Checks whether section exists
+ *
+ * \param cfg          config handle to search in
+ * \param section      section name to search for
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+bool ConfigHasSection(const Config *cfg, const char *section)
+{
+	ConfigSection *sect = NULL;
+
+	return ( (ConfigGetSection(cfg, section, &sect) == CONFIG_OK) ? true : false );
+}
+
+/**
+ * \brief              ConfigGetKeyValue() gets the ConfigKeyValue *
+ *
+ * \param cfg          config handle
+ * \param sect         section to search in
+ * \param key          key to search for
+ * \param kv           pointer to ConfigKeyValue* searched for to save
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+static ConfigRet ConfigGetKeyValue(const Config *cfg, ConfigSection *sect, const char *key,
+		ConfigKeyValue **kv)
+{
+	unsigned int ncmp = 0;
+
+	if (!sect || !key || !kv)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	return FindKeyValue(sect, key, kv, &ncmp);
+}
+
+/* counts a read of kv, only every prof_period'th read of a thread and first reads are recorded */
+static void ProfileRecord(const Config *cfg, ConfigKeyValue *kv)
+{
+	struct timespec ts;
+	unsigned int    n = ((++prof_tick & (cfg->prof_period - 1)) == 0) ? cfg->prof_period : 0;
+
+	/* first read of a key is always recorded, so a key with no reads has never been read */
+	if (!n && (__atomic_load_n(&kv->reads, __ATOMIC_RELAXED) == 0))
+		n = 1;
+	if (!n)
+		return;
+
+	clock_gettime(PROFILE_CLOCK, &ts);
+
+	__atomic_add_fetch(&kv->reads, n, __ATOMIC_RELAXED);
+	__atomic_store_n(&kv->atime, (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+			__ATOMIC_RELAXED);
+}
+
+/**
+ * \brief              ConfigLookup() finds the key-value read by ConfigRead*() functions
+ *                     and updates lookup statistics
+ *
+ * \param cfg          config handle
+ * \param section      section to search in
+ * \param key          key to search for
+ * \param kv           pointer to ConfigKeyValue* searched for to save
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+static ConfigRet ConfigLookup(const Config *cfg, const char *section, const char *key,
+		ConfigKeyValue **kv)
+{
+	ConfigSection *sect = NULL;
+	unsigned int   ncmp = 0;
+	ConfigRet      ret;
+
+	if ((ret = FindSection(cfg, section, &sect, &ncmp)) == CONFIG_OK)
+		ret = FindKeyValue(sect, key, kv, &ncmp);
+
+	PROBE3(lookup, section, key, ret);
+
+	if (cfg->prof_period && (ret == CONFIG_OK))
+		ProfileRecord(cfg, *kv);
+
+	if (cfg->stats) {
+		STAT_INC(cfg, lookups);
+		STAT_ADD(cfg, compares, ncmp);
+		switch (ret) {
+			case CONFIG_OK:            STAT_INC(cfg, hits);         break;
+			case CONFIG_ERR_NO_SECTION: STAT_INC(cfg, miss_section); break;
+			default:                   STAT_INC(cfg, miss_key);     break;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * \brief            ConfigGetSectionCount() gets number of sections
+ *
+ * \param cfg        config handle to search in
+ *
+ * \return           Returns number of sections on success, -1 on failure.
+ */
+int ConfigGetSectionCount(const Config *cfg)
+{
+	if (!cfg)
+		return -1;
+
+	return (TAILQ_FIRST(&cfg->sect_list)->numofkv > 0 ? cfg->numofsect : cfg->numofsect - 1);
+}
+
+/**
+ * \brief            ConfigGetKeyCount() gets number of keys
+ *
+ * \param cfg        config handle to search in
+ * \param section    section name to search for
+ *
+ * \return           Returns number of keys on success, -1 on failure.
+ */
+int ConfigGetKeyCount(const Config *cfg, const char *section)
+{
+	ConfigSection *sect = NULL;
+
+	if (!cfg)
+		return -1;
+
+	if (ConfigGetSection(cfg, section, &sect) != CONFIG_OK)
+		return -1;
+
+	return sect->numofkv;
+}
+
+/**
+ * \brief            ConfigGetMemoryUsage() gets memory used by cfg. The usage is kept up to
+ *                   date by every change of cfg, so this call does not walk the config
+ *
+ * \param cfg        config handle
+ * \param mem        memory usage to fill
+ *
+ * \return           ConfigRet
+ */
+ConfigRet ConfigGetMemoryUsage(const Config *cfg, ConfigMemStats *mem)
+{
+	if (!cfg || !mem)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*mem = cfg->mem;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief            ConfigGetSectionMemoryUsage() gets memory used by a section and its keys
+ *
+ * \param cfg        config handle
+ * \param section    section name
+ * \param mem        memory usage to fill
+ *
+ * \return           ConfigRet
+ */
+ConfigRet ConfigGetSectionMemoryUsage(const Config *cfg, const char *section, ConfigMemStats *mem)
+{
+	ConfigSection *sect = NULL;
+	ConfigRet      ret;
+
+	if (!cfg || !mem)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((ret = ConfigGetSection(cfg, section, &sect)) != CONFIG_OK)
+		return ret;
+
+	*mem = sect->mem;
+
+	return CONFIG_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * \brief              ConfigReadString() reads a string value from the cfg.
+ *                     If any error occurs default value is copied to 'value' buffer and
+ *                     returns reason. If key is optional and does not exists in config,
+ *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ *
+ * \param cfg          config handle
  * \param section      section to search in
  * \param key          key to search for
  * \param value        value to save in
@@ -348,224 +1307,4389 @@ int ConfigGetKeyCount(const Config *cfg, const char *section)
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigReadString(const Config *cfg, const char *section, const char *key,
-		char *value, int size, const char *dfl_value)
+ConfigRet ConfigReadString(const Config *cfg, const char *section, const char *key,
+		char *value, int size, const char *dfl_value)
+{
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+
+	if (!cfg || !key || !value || (size < 1))
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*value = '\0';
+
+	if ((ret = ConfigLookup(cfg, section, key, &kv)) != CONFIG_OK) {
+		if (dfl_value)
+			StrSafeCopy(value, dfl_value, size);
+		return ret;
+	}
+
+	StrSafeCopy(value, kv->value, size);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigReadInt() reads an integer value from the cfg.
+ *                     If any error occurs default value is copied to 'value' buffer and
+ *                     returns reason. If key is optional and does not exists in config,
+ *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ *
+ * \param cfg          config handle
+ * \param section      section to search in
+ * \param key          key to search for
+ * \param value        value to save in
+ * \param dfl_value    default value to copy back if any error occurs
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadInt(const Config *cfg, const char *section, const char *key,
+		int *value, int dfl_value)
+{
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+	char           *p    = NULL;
+
+	if (!cfg || !key || !value)
+		return  CONFIG_ERR_INVALID_PARAM;
+
+	*value = dfl_value;
+
+	if ((ret = ConfigLookup(cfg, section, key, &kv)) != CONFIG_OK)
+		return ret;
+
+	*value = (int) strtol(kv->value, &p, 10);
+	if (*p || (errno == ERANGE)) {
+		STAT_INC(cfg, parse_failures);
+		return CONFIG_ERR_INVALID_VALUE;
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigReadUnsignedInt() reads an unsigned integer value from the cfg.
+ *                     If any error occurs default value is copied to 'value' buffer and
+ *                     returns reason. If key is optional and does not exists in config,
+ *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ *
+ * \param cfg          config handle
+ * \param section      section to search in
+ * \param key          key to search for
+ * \param value        value to save in
+ * \param dfl_value    default value to copy back if any error occurs
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadUnsignedInt(const Config *cfg, const char *section, const char *key,
+		unsigned int *value, unsigned int dfl_value)
+{
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+	char           *p    = NULL;
+
+	if (!cfg || !key || !value)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*value = dfl_value;
+
+	if ((ret = ConfigLookup(cfg, section, key, &kv)) != CONFIG_OK)
+		return ret;
+
+	*value = (unsigned int) strtoul(kv->value, &p, 10);
+	if (*p || (errno == ERANGE)) {
+		STAT_INC(cfg, parse_failures);
+		return CONFIG_ERR_INVALID_VALUE;
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigReadFloat() reads a float value from the cfg.
+ *                     If any error occurs default value is copied to 'value' buffer and
+ *                     returns reason. If key is optional and does not exists in config,
+ *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ *
+ * \param cfg          config handle
+ * \param section      section to search in
+ * \param key          key to search for
+ * \param value        value to save in
+ * \param dfl_value    default value to copy back if any error occurs
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadFloat(const Config *cfg, const char *section, const char *key,
+		float *value, float dfl_value)
+{
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+	char           *p    = NULL;
+
+	if (!cfg || !key || !value)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*value = dfl_value;
+
+	if ((ret = ConfigLookup(cfg, section, key, &kv)) != CONFIG_OK)
+		return ret;
+
+	*value = strtof(kv->value, &p);
+	if (*p || (errno == ERANGE)) {
+		STAT_INC(cfg, parse_failures);
+		return CONFIG_ERR_INVALID_VALUE;
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigReadDouble() reads a double value from the cfg.
+ *                     If any error occurs default value is copied to 'value' buffer and
+ *                     returns reason. If key is optional and does not exists in config,
+ *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ *
+ * \param cfg          config handle
+ * \param section      section to search in
+ * \param key          key to search for
+ * \param value        value to save in
+ * \param dfl_value    default value to copy back if any error occurs
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadDouble(const Config *cfg, const char *section, const char *key,
+		double *value, double dfl_value)
+{
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+	char           *p    = NULL;
+
+	if (!cfg || !key || !value)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*value = dfl_value;
+
+	if ((ret = ConfigLookup(cfg, section, key, &kv)) != CONFIG_OK)
+		return ret;
+
+	*value = strtod(kv->value, &p);
+	if (*p || (errno == ERANGE)) {
+		STAT_INC(cfg, parse_failures);
+		return CONFIG_ERR_INVALID_VALUE;
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigReadBool() reads a boolean value from the cfg.
+ *                     If any error occurs default value is copied to 'value' buffer and
+ *                     returns reason. If key is optional and does not exists in config,
+ *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ *
+ * \param cfg          config handle
+ * \param section      section to search in
+ * \param key          key to search for
+ * \param value        value to save in
+ * \param dfl_value    default value to copy back if any error occurs
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadBool(const Config *cfg, const char *section, const char *key,
+		bool *value, bool dfl_value)
+{
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+
+	if (!cfg || !key || !value)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*value = dfl_value;
+
+	if ((ret = ConfigLookup(cfg, section, key, &kv)) != CONFIG_OK)
+		return ret;
+
+	if (StrIsTypeOfTrue(kv->value))
+		*value = true;
+	else if (StrIsTypeOfFalse(kv->value))
+		*value = false;
+	else {
+		STAT_INC(cfg, parse_failures);
+		return CONFIG_ERR_INVALID_VALUE;
+	}
+
+	return CONFIG_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Subscriptions of a single key are indexed by hash of section and key, prefix subscriptions
+ * by hash of section only. A change visits these two buckets instead of all subscriptions.
+ */
+static unsigned int SubHash(unsigned int shash, unsigned int khash, bool prefix)
+{
+	return prefix ? shash : (unsigned int) Mix64(((unsigned long long) shash << 32) | khash);
+}
+
+static void SubMark(Config *cfg, ConfigSubscription *sub)
+{
+	++sub->nchanges;
+	if (!sub->pending) {
+		sub->pending = true;
+		TAILQ_INSERT_TAIL(&cfg->sub_pending, sub, next);
+	}
+}
+
+/* records a change of kv for the subscriptions it matches */
+static void SubNotify(Config *cfg, const ConfigSection *sect, const ConfigKeyValue *kv)
+{
+	ConfigSubscription *sub;
+	unsigned int        h;
+
+	if (!cfg->numofsubs)
+		return;
+
+	h = SubHash(sect->hash, kv->hash, false);
+	for (sub = cfg->sub_htab[h & (cfg->sub_htabsize - 1)]; sub; sub = sub->hnext) {
+		if ( (sub->prefixlen < 0) && (sub->hash == h) && StrEqual(sub->section, sect->name) &&
+			 !strcmp(sub->key, kv->key) )
+			SubMark(cfg, sub);
+	}
+
+	h = SubHash(sect->hash, 0, true);
+	for (sub = cfg->sub_htab[h & (cfg->sub_htabsize - 1)]; sub; sub = sub->hnext) {
+		if ( (sub->prefixlen >= 0) && (sub->hash == h) && StrEqual(sub->section, sect->name) &&
+			 !strncmp(sub->key, kv->key, sub->prefixlen) )
+			SubMark(cfg, sub);
+	}
+}
+
+/* records a change of every key of sect */
+static void SubNotifySection(Config *cfg, const ConfigSection *sect)
+{
+	ConfigKeyValue *kv;
+
+	if (!cfg->numofsubs)
+		return;
+
+	TAILQ_FOREACH(kv, &sect->kv_list, next) {
+		SubNotify(cfg, sect, kv);
+	}
+}
+
+/* notifies pending subscriptions unless an update is open */
+static void SubFlush(Config *cfg)
+{
+	ConfigSubscription *sub;
+	int                 n;
+
+	if (cfg->txn || TAILQ_EMPTY(&cfg->sub_pending))
+		return;
+
+	/* changes made by callbacks are notified in the same loop */
+	++cfg->txn;
+	while ((sub = TAILQ_FIRST(&cfg->sub_pending)) != NULL) {
+		TAILQ_REMOVE(&cfg->sub_pending, sub, next);
+		sub->pending = false;
+		n = sub->nchanges;
+		sub->nchanges = 0;
+		sub->callback(cfg, sub->section, sub->key, n, sub->ctx);
+	}
+	--cfg->txn;
+}
+
+static void SubFree(ConfigSubscription *sub)
+{
+	if (sub->ownctx)
+		free(sub->ctx);
+	free(sub->section);
+	free(sub->key);
+	free(sub);
+}
+
+static void SubFreeAll(Config *cfg)
+{
+	ConfigSubscription *sub, *t_sub;
+	unsigned int        i;
+
+	for (i = 0; i < cfg->sub_htabsize; ++i) {
+		for (sub = cfg->sub_htab[i]; sub; sub = t_sub) {
+			t_sub = sub->hnext;
+			SubFree(sub);
+		}
+	}
+
+	free(cfg->sub_htab);
+	cfg->sub_htab = NULL;
+	cfg->sub_htabsize = 0;
+	cfg->numofsubs = 0;
+	TAILQ_INIT(&cfg->sub_pending);
+}
+
+static void SchemaError(Config *cfg, const char *fmt, ...)
+{
+	char    buf[SCHEMA_ERR_SIZE];
+	va_list ap;
+
+	/* fmt arguments may point to the previous message */
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	free(cfg->schema_err);
+	cfg->schema_err = strdup(buf);
+}
+
+static SchemaSection *SchemaFindSection(const ConfigSchema *schema, const char *section, unsigned int h)
+{
+	SchemaSection *ss;
+
+	for (ss = schema->htab[h & (schema->htabsize - 1)]; ss; ss = ss->hnext) {
+		if ((ss->hash == h) && StrEqual(ss->name, section))
+			return ss;
+	}
+
+	return NULL;
+}
+
+static SchemaKey *SchemaFindKey(const SchemaSection *ss, const char *key, unsigned int h)
+{
+	SchemaKey *sk;
+
+	for (sk = ss->htab[h & (ss->htabsize - 1)]; sk; sk = sk->hnext) {
+		if ((sk->hash == h) && !strcmp(sk->key, key))
+			return sk;
+	}
+
+	return NULL;
+}
+
+static int CompareStrings(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* checks value v of a key against its rule, reason of a failure is saved to msg */
+static bool SchemaCheckRule(const SchemaKey *sk, const char *v, const char **msg)
+{
+	char   *end = NULL;
+	double  num = 0;
+	long    l;
+
+	errno = 0;
+
+	switch (sk->type) {
+		case CONFIG_TYPE_INT:
+			l = strtol(v, &end, 10);
+			if ( !*v || *end || (errno == ERANGE) || (l < INT_MIN) || (l > INT_MAX) ) {
+				*msg = "is not an integer";
+				return false;
+			}
+			num = l;
+			break;
+
+		case CONFIG_TYPE_UNSIGNED_INT:
+			num = strtoul(v, &end, 10);
+			if ( !*v || *end || (errno == ERANGE) || (num > UINT_MAX) ) {
+				*msg = "is not an unsigned integer";
+				return false;
+			}
+			break;
+
+		case CONFIG_TYPE_FLOAT:
+			/* as ConfigReadFloat(), values out of the range of float are rejected */
+			num = strtof(v, &end);
+			if ( !*v || *end || (errno == ERANGE) ) {
+				*msg = "is not a number";
+				return false;
+			}
+			break;
+
+		case CONFIG_TYPE_DOUBLE:
+			num = strtod(v, &end);
+			if ( !*v || *end || (errno == ERANGE) ) {
+				*msg = "is not a number";
+				return false;
+			}
+			break;
+
+		case CONFIG_TYPE_BOOL:
+			if (!StrIsTypeOfTrue(v) && !StrIsTypeOfFalse(v)) {
+				*msg = "is not a boolean";
+				return false;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	if ( sk->ranged && (sk->type != CONFIG_TYPE_STRING) && (sk->type != CONFIG_TYPE_BOOL) &&
+		 ((num < sk->min) || (num > sk->max)) ) {
+		*msg = "is out of range";
+		return false;
+	}
+
+	if (sk->values && !bsearch(&v, sk->values, sk->numofvalues, sizeof(char *), CompareStrings)) {
+		*msg = "is not one of the allowed values";
+		return false;
+	}
+
+	if (sk->has_re && (regexec(&sk->re, v, 0, NULL, 0) != 0)) {
+		*msg = "does not match the pattern";
+		return false;
+	}
+
+	return true;
+}
+
+/* checks the value val[0..len) of a key being added to cfg */
+static ConfigRet SchemaCheckValue(Config *cfg, const char *section, const char *key,
+		const char *val, size_t len)
+{
+	SchemaSection *ss;
+	SchemaKey     *sk;
+	char           buf[SCHEMA_VALUE_BUF];
+	char          *v   = buf;
+	const char    *msg = NULL;
+	bool           ok;
+
+	if ( !(ss = SchemaFindSection(cfg->schema, section, StrHash(section))) ||
+		 !(sk = SchemaFindKey(ss, key, StrHash(key))) )
+		return CONFIG_OK;
+
+	if ((len >= sizeof(buf)) && ((v = malloc(len + 1)) == NULL))
+		return CONFIG_ERR_MEMALLOC;
+	memcpy(v, val, len);
+	v[len] = '\0';
+
+	if (!(ok = SchemaCheckRule(sk, v, &msg)))
+		SchemaError(cfg, "[%s] %s: value '%s' %s", section ? section : "", key, v, msg);
+
+	if (v != buf)
+		free(v);
+
+	return ok ? CONFIG_OK : CONFIG_ERR_INVALID_VALUE;
+}
+
+/* checks that the required keys of the schema exist in cfg */
+static ConfigRet SchemaCheckRequired(Config *cfg)
+{
+	SchemaSection  *ss;
+	SchemaKey      *sk;
+	ConfigSection  *sect;
+	ConfigKeyValue *kv;
+
+	TAILQ_FOREACH(ss, &cfg->schema->sect_list, next) {
+		if (ConfigGetSection(cfg, ss->name, &sect) != CONFIG_OK)
+			sect = NULL;
+
+		TAILQ_FOREACH(sk, &ss->key_list, next) {
+			if ( sk->required && (!sect || (ConfigGetKeyValue(cfg, sect, sk->key, &kv) != CONFIG_OK)) ) {
+				SchemaError(cfg, "[%s] %s: required key is missing", ss->name ? ss->name : "", sk->key);
+				return CONFIG_ERR_NO_KEY;
+			}
+		}
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigAddSection() creates a section in the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to add
+ * \param sect         pointer to added ConfigSection* or NULL if not needed
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+static ConfigRet ConfigAddSection(Config *cfg, const char *section, ConfigSection **sect)
+{
+	ConfigSection *_sect = NULL;
+	ConfigRet      ret   = CONFIG_OK;
+
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (!sect)
+		sect = &_sect;
+
+	if ((ret = ConfigGetSection(cfg, section, sect)) != CONFIG_ERR_NO_SECTION)
+		return ret;
+
+	*sect = CfgCalloc(cfg, 1, sizeof(ConfigSection));
+	if (*sect == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	if (section) {
+		if (((*sect)->name = CfgStrdup(cfg, section)) == NULL) {
+			free(*sect);
+			return CONFIG_ERR_MEMALLOC;
+		}
+	}
+
+	(*sect)->hash = StrHash(section);
+	(*sect)->cfg = cfg;
+	MemSect(*sect, 1);
+
+	TAILQ_INIT(&(*sect)->kv_list);
+	TAILQ_INSERT_TAIL(&cfg->sect_list, *sect, next);
+	++(cfg->numofsect);
+	SectIndexInsert(cfg, *sect);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigAddString() adds the key with string value to the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to add in
+ * \param key          key to save as
+ * \param value        value to save as
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigAddString(Config *cfg, const char *section, const char *key, const char *value)
+{
+	ConfigSection  *sect = NULL;
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+	const char     *p    = NULL;
+	const char     *q    = NULL;
+
+	if (!cfg || !key || !value)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	for (p = value; *p && isspace(*p); ++p)
+		;
+	for (q = p; *q && (*q != '\r') && (*q != '\n') && !strchr(cfg->comment_chars, *q); ++q)
+		;
+	while (*q && (q > p) && isspace(*(q - 1)))
+		--q;
+
+	/* invalid values are rejected before anything is changed */
+	if (cfg->schema && ((ret = SchemaCheckValue(cfg, section, key, p, q - p)) != CONFIG_OK))
+		return ret;
+
+	if ((ret = ConfigAddSection(cfg, section, &sect)) != CONFIG_OK)
+		return ret;
+
+	switch (ret = ConfigGetKeyValue(cfg, sect, key, &kv)) {
+		case CONFIG_OK:
+			break;
+
+		case CONFIG_ERR_NO_KEY:
+			if ((kv = CfgCalloc(cfg, 1, sizeof(ConfigKeyValue))) == NULL)
+				return CONFIG_ERR_MEMALLOC;
+			if (cfg->intern) {
+				kv->key = InternGet(cfg, key, strlen(key), &kv->hash);
+				kv->interned = KV_KEY_INTERNED;
+			}
+			else {
+				kv->key  = CfgStrdup(cfg, key);
+				kv->hash = StrHash(key);
+			}
+			if (kv->key == NULL) {
+				free(kv);
+				return CONFIG_ERR_MEMALLOC;
+			}
+			MemKeyVal(sect, kv, 1);
+			TAILQ_INSERT_TAIL(&sect->kv_list, kv, next);
+			++(sect->numofkv);
+			KeyValIndexInsert(cfg, sect, kv);
+			break;
+
+		default:
+			return ret;
+	}
+
+	/* an unchanged value is neither copied nor reported to subscribers */
+	if ( kv->value && (strlen(kv->value) == (size_t) (q - p)) && !memcmp(kv->value, p, q - p) ) {
+		PROBE3(add, section, key, kv->value);
+		return CONFIG_OK;
+	}
+
+	if (kv->value) {
+		sect->digest -= kv->digest;
+		MemValue(sect, kv, -1);
+		KeyValFreeValue(kv);
+	}
+
+	if (cfg->intern) {
+		kv->value = InternGet(cfg, p, q - p, &kv->vhash);
+		if (kv->value)
+			kv->interned |= KV_VALUE_INTERNED;
+	}
+	else if ((kv->value = (char *) CfgMalloc(cfg, q - p + 1)) != NULL) {
+		memcpy(kv->value, p, q - p);
+		kv->value[q - p] = '\0';
+		kv->vhash = StrHash(kv->value);
+	}
+
+	if (kv->value == NULL) {
+		/* an existing key is lost */
+		if (ret == CONFIG_OK)
+			SubNotify(cfg, sect, kv);
+		MemKeyVal(sect, kv, -1);
+		KeyValIndexRemove(sect, kv);
+		TAILQ_REMOVE(&sect->kv_list, kv, next);
+		--(sect->numofkv);
+		KeyValFree(kv);
+		SubFlush(cfg);
+		return CONFIG_ERR_MEMALLOC;
+	}
+
+	kv->digest = KeyValDigest(kv->key, kv->value);
+	sect->digest += kv->digest;
+	MemValue(sect, kv, 1);
+	SubNotify(cfg, sect, kv);
+
+	PROBE3(add, section, key, kv->value);
+
+	SubFlush(cfg);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigAddInt() adds the key with integer value to the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to add in
+ * \param key          key to save as
+ * \param value        value to save as
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigAddInt(Config *cfg, const char *section, const char *key, int value)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%d", value);
+
+	return ConfigAddString(cfg, section, key, buf);
+}
+
+/**
+ * \brief              ConfigAddUnsignedInt() adds the key with unsigned integer value to the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to add in
+ * \param key          key to save as
+ * \param value        value to save as
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigAddUnsignedInt(Config *cfg, const char *section, const char *key, unsigned int value)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%u", value);
+
+	return ConfigAddString(cfg, section, key, buf);
+}
+
+/**
+ * \brief              ConfigAddFloat() adds the key with float value to the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to add in
+ * \param key          key to save as
+ * \param value        value to save as
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigAddFloat(Config * cfg, const char *section, const char *key, float value)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%f", value);
+
+	return ConfigAddString(cfg, section, key, buf);
+}
+
+/**
+ * \brief              ConfigAddDouble() adds the key with double value to the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to add in
+ * \param key          key to save as
+ * \param value        value to save as
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigAddDouble(Config *cfg, const char *section, const char *key, double value)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%f", value);
+
+	return ConfigAddString(cfg, section, key, buf);
+}
+
+/**
+ * \brief              ConfigAddBool() adds the key with blooean value to the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to add in
+ * \param key          key to save as
+ * \param value        value to save as
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigAddBool(Config * cfg, const char *section, const char *key, bool value)
+{
+	return ConfigAddString(cfg, section, key, value ? cfg->true_str : cfg->false_str);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void _ConfigRemoveKey(ConfigSection *sect, ConfigKeyValue *kv)
+{
+	KeyValIndexRemove(sect, kv);
+	TAILQ_REMOVE(&sect->kv_list, kv, next);
+	--(sect->numofkv);
+	if (kv->value)
+		sect->digest -= kv->digest;
+
+	MemKeyVal(sect, kv, -1);
+	KeyValFree(kv);
+}
+
+/**
+ * \brief              ConfigRemoveKey() removes the key which exists under section from the cfg
+ *
+ * \param cfg          config handle
+ * \param section      section to seach in
+ * \param key          key to remove
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigRemoveKey(Config *cfg, const char *section, const char *key)
+{
+	ConfigSection  *sect = NULL;
+	ConfigKeyValue *kv   = NULL;
+	ConfigRet       ret  = CONFIG_OK;
+
+	if (!cfg || !key)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((ret = ConfigGetSection(cfg, section, &sect)) == CONFIG_OK) {
+		if ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) == CONFIG_OK) {
+			SubNotify(cfg, sect, kv);
+			_ConfigRemoveKey(sect, kv);
+		}
+	}
+
+	PROBE3(remove, section, key, ret);
+
+	SubFlush(cfg);
+
+	return ret;
+}
+
+static void _ConfigRemoveSection(Config *cfg, ConfigSection *sect)
+{
+	ConfigKeyValue *kv, *t_kv;
+
+	if (!cfg || !sect)
+		return;
+
+	SectIndexRemove(cfg, sect);
+	TAILQ_REMOVE(&cfg->sect_list, sect, next);
+	--(cfg->numofsect);
+
+	TAILQ_FOREACH_SAFE(kv, &sect->kv_list, next, t_kv) {
+		_ConfigRemoveKey(sect, kv);
+	}
+
+	MemSect(sect, -1);
+	SectFree(sect);
+}
+
+/**
+ * \brief              ConfigRemoveSection() removes section from the cfgfile
+ *
+ * \param cfg          config handle
+ * \param section      section to remove
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigRemoveSection(Config *cfg, const char *section)
+{
+	ConfigSection *sect = NULL;
+	ConfigRet      ret  = CONFIG_OK;
+
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((ret = ConfigGetSection(cfg, section, &sect)) == CONFIG_OK) {
+		SubNotifySection(cfg, sect);
+		_ConfigRemoveSection(cfg, sect);
+		SubFlush(cfg);
+	}
+
+	return ret;
+}
+
+/**
+ * \brief              ConfigNew() creates a cfg handle with
+ *                     default section which has no section name
+ *
+ * \return             Config* handle on success, NULL on failure
+ */
+Config *ConfigNew()
+{
+	Config *cfg = NULL;
+
+	cfg = calloc(1, sizeof(Config));
+	if (cfg == NULL)
+		return NULL;
+
+	MemAccount(cfg, NULL, offsetof(ConfigMemStats, nodes), NULL, cfg, sizeof(Config), 1);
+
+	TAILQ_INIT(&cfg->sect_list);
+	TAILQ_INIT(&cfg->sub_pending);
+
+	/* add default section */
+	if (ConfigAddSection(cfg, CONFIG_SECTION_FLAT, NULL) != CONFIG_OK) {
+		free(cfg->sect_htab);
+		free(cfg);
+		return NULL;
+	}
+
+	cfg->comment_chars = strdup(COMMENT_CHARS);
+	cfg->keyval_sep = KEYVAL_SEP;
+	cfg->true_str = strdup(STR_TRUE);
+	cfg->false_str = strdup(STR_FALSE);
+	cfg->initnum = CONFIG_INIT_MAGIC;
+	cfg->refcnt = 1;
+
+	return cfg;
+}
+
+/**
+ * \brief          ConfigFree() frees the memory for the cfg handle
+ *
+ * \param cfg      config handle
+ */
+void ConfigFree(Config *cfg)
+{
+	ConfigSection *sect, *t_sect;
+
+	if (cfg == NULL)
+		return;
+
+	SubFreeAll(cfg);
+
+	TAILQ_FOREACH_SAFE(sect, &cfg->sect_list, next, t_sect) {
+		_ConfigRemoveSection(cfg, sect);
+	}
+
+	if (cfg->comment_chars) free(cfg->comment_chars);
+	if (cfg->true_str)      free(cfg->true_str);
+	if (cfg->false_str)     free(cfg->false_str);
+	if (cfg->sect_htab)     free(cfg->sect_htab);
+	if (cfg->stats)         free(cfg->stats);
+	if (cfg->intern)        InternUnref(cfg->intern);
+	if (cfg->schema_err)    free(cfg->schema_err);
+
+	free(cfg);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/* adds parsing and allocation statistics of a handle read on behalf of dst */
+static void StatsAbsorb(Config *dst, const Config *src)
+{
+	if (!src || !src->stats)
+		return;
+
+	STAT_ADD(dst, bytes_parsed, src->stats->bytes_parsed);
+	STAT_ADD(dst, lines_parsed, src->stats->lines_parsed);
+	STAT_ADD(dst, allocs,       src->stats->allocs);
+	STAT_ADD(dst, alloc_bytes,  src->stats->alloc_bytes);
+}
+
+/**
+ * \brief              ConfigEnableStats() enables or disables runtime statistics of the
+ *                     handle. Counters are updated with relaxed atomics, so reading a
+ *                     handle from several threads stays safe. Disabling frees the counters.
+ *                     Handles parsed on behalf of cfg (includes, directory fragments)
+ *                     inherit the setting and their counters are added to cfg.
+ *
+ * \param cfg          config handle
+ * \param enable       true to start counting, false to stop
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigEnableStats(Config *cfg, bool enable)
+{
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (enable && !cfg->stats) {
+		if ((cfg->stats = calloc(1, sizeof(ConfigStats))) == NULL)
+			return CONFIG_ERR_MEMALLOC;
+	}
+	else if (!enable && cfg->stats) {
+		free(cfg->stats);
+		cfg->stats = NULL;
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigGetStats() gets runtime statistics of the handle.
+ *                     All counters are zero if statistics are not enabled.
+ *
+ * \param cfg          config handle
+ * \param stats        statistics to save in
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigGetStats(const Config *cfg, ConfigStats *stats)
+{
+	if (!cfg || !stats)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	memset(stats, 0, sizeof(ConfigStats));
+
+	if (cfg->stats) {
+		stats->lookups        = __atomic_load_n(&cfg->stats->lookups,        __ATOMIC_RELAXED);
+		stats->hits           = __atomic_load_n(&cfg->stats->hits,           __ATOMIC_RELAXED);
+		stats->miss_section   = __atomic_load_n(&cfg->stats->miss_section,   __ATOMIC_RELAXED);
+		stats->miss_key       = __atomic_load_n(&cfg->stats->miss_key,       __ATOMIC_RELAXED);
+		stats->compares       = __atomic_load_n(&cfg->stats->compares,       __ATOMIC_RELAXED);
+		stats->parse_failures = __atomic_load_n(&cfg->stats->parse_failures, __ATOMIC_RELAXED);
+		stats->bytes_parsed   = __atomic_load_n(&cfg->stats->bytes_parsed,   __ATOMIC_RELAXED);
+		stats->lines_parsed   = __atomic_load_n(&cfg->stats->lines_parsed,   __ATOMIC_RELAXED);
+		stats->allocs         = __atomic_load_n(&cfg->stats->allocs,         __ATOMIC_RELAXED);
+		stats->alloc_bytes    = __atomic_load_n(&cfg->stats->alloc_bytes,    __ATOMIC_RELAXED);
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigResetStats() sets all runtime statistics of the handle to zero
+ *
+ * \param cfg          config handle
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigResetStats(Config *cfg)
+{
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (cfg->stats) {
+		__atomic_store_n(&cfg->stats->lookups,        0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->hits,           0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->miss_section,   0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->miss_key,       0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->compares,       0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->parse_failures, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->bytes_parsed,   0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->lines_parsed,   0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->allocs,         0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cfg->stats->alloc_bytes,    0, __ATOMIC_RELAXED);
+	}
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigEnableAccessProfile() enables or disables the access profiler
+ *                     of the handle. Every sample_period'th read of a thread updates the read
+ *                     counter (by sample_period) and the last access time of the key read,
+ *                     so the counters estimate read frequency at a fraction of the cost.
+ *                     The first read of each key is always recorded, so keys reported as
+ *                     never read have not been read since the profiler was enabled.
+ *                     Counters collected so far are kept when the profiler is disabled.
+ *
+ * \param cfg          config handle
+ * \param period       sample period, rounded up to a power of 2 (1 records every read),
+ *                     0 to disable
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigEnableAccessProfile(Config *cfg, unsigned int period)
+{
+	unsigned int p = 1;
+
+	if (!cfg || (period > (1U << 30)))
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (period) {
+		while (p < period)
+			p <<= 1;
+	}
+	else
+		p = 0;
+
+	cfg->prof_period = p;
+
+	return CONFIG_OK;
+}
+
+/* counters are copied, since the handle may be read while the profile is sorted */
+typedef struct ProfileEntry
+{
+	const ConfigSection  *sect;
+	const ConfigKeyValue *kv;
+	unsigned int          reads;
+	unsigned long long    atime;
+} ProfileEntry;
+
+static int CompareProfileEntries(const void *a, const void *b)
+{
+	const ProfileEntry *e1 = a, *e2 = b;
+
+	if (e1->reads != e2->reads)
+		return (e1->reads < e2->reads) ? 1 : -1;
+
+	return (e1->atime < e2->atime) ? 1 : (e1->atime > e2->atime) ? -1 : 0;
+}
+
+/**
+ * \brief              ConfigDumpAccessProfile() prints the most read keys with their
+ *                     estimated read counts and time since their last read, followed by
+ *                     the keys which have never been read.
+ *
+ * \param cfg          config handle
+ * \param stream       output stream
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigDumpAccessProfile(const Config *cfg, FILE *stream)
+{
+	ConfigSection   *sect;
+	ConfigKeyValue  *kv;
+	ProfileEntry    *ents;
+	struct timespec  ts;
+	unsigned long long now;
+	int              n = 0, numofkv = 0, numofread, i;
+
+	if (!cfg || !stream)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		numofkv += sect->numofkv;
+	}
+
+	if ((ents = malloc((numofkv ? numofkv : 1) * sizeof(ProfileEntry))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		TAILQ_FOREACH(kv, &sect->kv_list, next) {
+			ents[n].sect  = sect;
+			ents[n].kv    = kv;
+			ents[n].reads = __atomic_load_n(&kv->reads, __ATOMIC_RELAXED);
+			ents[n++].atime = __atomic_load_n(&kv->atime, __ATOMIC_RELAXED);
+		}
+	}
+
+	qsort(ents, n, sizeof(ProfileEntry), CompareProfileEntries);
+
+	for (numofread = 0; (numofread < n) && ents[numofread].reads; ++numofread)
+		;
+
+	clock_gettime(PROFILE_CLOCK, &ts);
+	now = (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	fprintf(stream, "%c access profile: %d keys, %d read, %d never read, sample period %u\n",
+			cfg->comment_chars[0], n, numofread, n - numofread, cfg->prof_period);
+
+	fprintf(stream, "\n%c hot keys: reads, seconds since last read, section, key\n", cfg->comment_chars[0]);
+	for (i = 0; (i < numofread) && (i < PROFILE_HOT_KEYS); ++i) {
+		fprintf(stream, "%10u %10.1f  [%s] %s\n", ents[i].reads,
+				(now > ents[i].atime) ? (now - ents[i].atime) / 1e9 : 0.0,
+				ents[i].sect->name ? ents[i].sect->name : "", ents[i].kv->key);
+	}
+
+	fprintf(stream, "\n%c never read keys: section, key\n", cfg->comment_chars[0]);
+	for (i = numofread; i < n; ++i)
+		fprintf(stream, "[%s] %s\n", ents[i].sect->name ? ents[i].sect->name : "", ents[i].kv->key);
+
+	free(ents);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigSaveAccessProfile() saves the read counters of the handle as a
+ *                     config file ([section] key = reads) which ConfigLoadAccessProfile() reads
+ *                     back. Keys which have never been read are not saved.
+ *
+ * \param cfg          config handle
+ * \param filename     file to save to
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigSaveAccessProfile(const Config *cfg, const char *filename)
+{
+	ConfigSection  *sect;
+	ConfigKeyValue *kv;
+	ConfigWriter   *w;
+	FILE           *fp;
+	unsigned int    reads;
+	bool            header;
+	ConfigRet       ret;
+
+	if (!cfg || !filename)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((fp = fopen(filename, "w")) == NULL)
+		return CONFIG_ERR_FILE;
+
+	if ((w = ConfigWriterOpen(fileno(fp))) == NULL) {
+		fclose(fp);
+		return CONFIG_ERR_MEMALLOC;
+	}
+
+	/* flat section is the first one, so its keys are written before any section header */
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		header = (sect->name == NULL);
+		TAILQ_FOREACH(kv, &sect->kv_list, next) {
+			if ((reads = __atomic_load_n(&kv->reads, __ATOMIC_RELAXED)) == 0)
+				continue;
+			if (!header) {
+				ConfigWriterSection(w, sect->name);
+				header = true;
+			}
+			ConfigWriterKeyUnsignedInt(w, kv->key, reads);
+		}
+	}
+
+	ret = ConfigWriterClose(w);
+	if ((fclose(fp) != 0) && (ret == CONFIG_OK))
+		ret = CONFIG_ERR_FILE;
+
+	return ret;
+}
+
+/**
+ * \brief              ConfigLoadAccessProfile() sets read counters of the handle from a file
+ *                     saved by ConfigSaveAccessProfile(), typically before ConfigRelayout()
+ *                     is called on a freshly loaded config. Keys which are not in the handle
+ *                     are ignored.
+ *
+ * \param cfg          config handle
+ * \param filename     file to load from
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigLoadAccessProfile(Config *cfg, const char *filename)
+{
+	Config         *prof = NULL;
+	ConfigSection  *psect, *sect;
+	ConfigKeyValue *pkv, *kv;
+	ConfigRet       ret;
+
+	if (!cfg || !filename)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((ret = ConfigReadFile(filename, &prof)) != CONFIG_OK)
+		return ret;
+
+	TAILQ_FOREACH(psect, &prof->sect_list, next) {
+		if (ConfigGetSection(cfg, psect->name, &sect) != CONFIG_OK)
+			continue;
+		TAILQ_FOREACH(pkv, &psect->kv_list, next) {
+			if (ConfigGetKeyValue(cfg, sect, pkv->key, &kv) == CONFIG_OK)
+				kv->reads = (unsigned int) strtoul(pkv->value, NULL, 10);
+		}
+	}
+
+	ConfigFree(prof);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              Section or key-value being moved by ConfigRelayout()
+ */
+typedef struct RelayoutItem
+{
+	void               *old;
+	void               *obj;              /* copy placed in an arena */
+	unsigned long long  reads;            /* reads of the key, or of all keys of the section */
+	int                 pos;              /* position in list order */
+	int                 sect;             /* key-values: index of its section item */
+} RelayoutItem;
+
+/**
+ * \brief              Bump allocator over an arena. Without an arena only the size is counted.
+ */
+typedef struct ArenaPlacer
+{
+	ConfigArena *arena;
+	size_t       off;
+	int          numofobj;
+} ArenaPlacer;
+
+static void *PlaceAlloc(ArenaPlacer *pl, size_t size, size_t align)
+{
+	void *p;
+
+	pl->off = (pl->off + align - 1) & ~(align - 1);
+	p = pl->arena ? pl->arena->data + pl->off : NULL;
+	pl->off += size;
+
+	return p;
+}
+
+static char *PlaceStr(ArenaPlacer *pl, const char *s)
+{
+	size_t  len = strlen(s) + 1;
+	char   *p   = PlaceAlloc(pl, len, 1);
+
+	if (p)
+		memcpy(p, s, len);
+
+	return p;
+}
+
+/*
+ * Places section structs first, then their names and key indexes, then every key-value
+ * followed by its own key and value, so a lookup touches few adjacent cache lines.
+ */
+static void PlaceBlock(ArenaPlacer *pl, RelayoutItem **sects, int numofsect,
+		RelayoutItem **kvs, int numofkv)
+{
+	ConfigSection   *sect, *osect;
+	ConfigKeyValue  *kv, *okv, **htab;
+	char            *key, *val, *name;
+	int              i;
+
+	for (i = 0; i < numofsect; ++i) {
+		if ((sect = sects[i]->obj = PlaceAlloc(pl, sizeof(ConfigSection), ARENA_ALIGN)) != NULL) {
+			*sect = *(ConfigSection *) sects[i]->old;
+			sect->arena = pl->arena;
+		}
+		++pl->numofobj;
+	}
+
+	for (i = 0; i < numofsect; ++i) {
+		osect = sects[i]->old;
+		name = osect->name ? PlaceStr(pl, osect->name) : NULL;
+		if ((sect = sects[i]->obj) != NULL)
+			sect->name = name;
+	}
+
+	for (i = 0; i < numofsect; ++i) {
+		osect = sects[i]->old;
+		if (!osect->kv_htab)
+			continue;
+		htab = PlaceAlloc(pl, osect->kv_htabsize * sizeof(ConfigKeyValue *), ARENA_ALIGN);
+		if ((sect = sects[i]->obj) != NULL) {
+			memset(htab, 0, osect->kv_htabsize * sizeof(ConfigKeyValue *));
+			sect->kv_htab = htab;
+		}
+	}
+
+	for (i = 0; i < numofkv; ++i) {
+		okv = kvs[i]->old;
+		kv  = kvs[i]->obj = PlaceAlloc(pl, sizeof(ConfigKeyValue), ARENA_ALIGN);
+		/* interned strings stay shared with other key-values */
+		key = (okv->interned & KV_KEY_INTERNED) ? okv->key : PlaceStr(pl, okv->key);
+		val = okv->value;
+		if (val && !(okv->interned & KV_VALUE_INTERNED))
+			val = PlaceStr(pl, okv->value);
+		++pl->numofobj;
+
+		if (kv) {
+			*kv = *okv;
+			kv->arena = pl->arena;
+			kv->key   = key;
+			kv->value = val;
+		}
+	}
+}
+
+/* hottest first, list order among equals */
+static int CompareRelayoutItems(const void *a, const void *b)
+{
+	const RelayoutItem *i1 = *(const RelayoutItem **) a, *i2 = *(const RelayoutItem **) b;
+
+	if (i1->reads != i2->reads)
+		return (i1->reads < i2->reads) ? 1 : -1;
+
+	return i1->pos - i2->pos;
+}
+
+/* allocates the arena sized by a counting pass, NULL arena if nothing is placed in it */
+static ConfigRet ArenaNew(const Config *cfg, ArenaPlacer *pl)
+{
+	size_t size = pl->off;
+	int    n    = pl->numofobj;
+
+	memset(pl, 0, sizeof(ArenaPlacer));
+	if (n == 0)
+		return CONFIG_OK;
+
+	if ((pl->arena = CfgMalloc(cfg, sizeof(ConfigArena) + size)) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	pl->arena->refcnt = n;
+	pl->arena->size = size;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigRelayout() rebuilds the storage of the handle from its access
+ *                     profile (see ConfigEnableAccessProfile(), ConfigLoadAccessProfile()).
+ *                     Sections and key-values which have been read are copied into one
+ *                     contiguous hot block, most read first; the others are copied into a
+ *                     cold block. Hash chains are relinked so hot entries are compared
+ *                     first. Order of sections and keys seen by iteration is unchanged.
+ *                     Keys added later are allocated separately as usual. The handle must
+ *                     not be used by other threads during the call.
+ *
+ * \param cfg          config handle
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error and the
+ *                     handle is unchanged.
+ */
+ConfigRet ConfigRelayout(Config *cfg)
+{
+	RelayoutItem    *sitems = NULL, *kitems = NULL;
+	RelayoutItem   **sorder = NULL, **korder = NULL;
+	ArenaPlacer      hot, cold;
+	ConfigSection   *sect, **sb;
+	ConfigKeyValue  *kv, **kb;
+	int              numofkv = 0, numofhotsect = 0, numofhotkv = 0;
+	int              n, k, i;
+	ConfigRet        ret = CONFIG_ERR_MEMALLOC;
+
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		numofkv += sect->numofkv;
+	}
+
+	if ( ((sitems = calloc(cfg->numofsect, sizeof(RelayoutItem))) == NULL) ||
+		 ((sorder = malloc(cfg->numofsect * sizeof(RelayoutItem *))) == NULL) ||
+		 ((kitems = calloc(numofkv + 1, sizeof(RelayoutItem))) == NULL) ||
+		 ((korder = malloc((numofkv + 1) * sizeof(RelayoutItem *))) == NULL) )
+		goto out;
+
+	n = k = 0;
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		sitems[n].old = sect;
+		sitems[n].pos = n;
+		TAILQ_FOREACH(kv, &sect->kv_list, next) {
+			kitems[k].old   = kv;
+			kitems[k].pos   = k;
+			kitems[k].sect  = n;
+			kitems[k].reads = kv->reads;
+			sitems[n].reads += kv->reads;
+			korder[k] = &kitems[k];
+			++k;
+		}
+		sorder[n] = &sitems[n];
+		++n;
+	}
+
+	/* hottest first, ties and so all cold entries stay in list order */
+	qsort(sorder, n, sizeof(RelayoutItem *), CompareRelayoutItems);
+	qsort(korder, k, sizeof(RelayoutItem *), CompareRelayoutItems);
+
+	for (numofhotsect = 0; (numofhotsect < n) && sorder[numofhotsect]->reads; ++numofhotsect)
+		;
+	for (numofhotkv = 0; (numofhotkv < k) && korder[numofhotkv]->reads; ++numofhotkv)
+		;
+
+	/* size the blocks, then allocate both before anything is changed */
+	memset(&hot, 0, sizeof(hot));
+	memset(&cold, 0, sizeof(cold));
+	PlaceBlock(&hot,  sorder, numofhotsect, korder, numofhotkv);
+	PlaceBlock(&cold, sorder + numofhotsect, n - numofhotsect, korder + numofhotkv, k - numofhotkv);
+
+	if ( (ArenaNew(cfg, &hot) != CONFIG_OK) || (ArenaNew(cfg, &cold) != CONFIG_OK) ) {
+		if (hot.arena)
+			free(hot.arena);
+		goto out;
+	}
+
+	PlaceBlock(&hot,  sorder, numofhotsect, korder, numofhotkv);
+	PlaceBlock(&cold, sorder + numofhotsect, n - numofhotsect, korder + numofhotkv, k - numofhotkv);
+
+	/* relink lists in their original order */
+	TAILQ_INIT(&cfg->sect_list);
+	for (i = 0; i < n; ++i) {
+		sect = sitems[i].obj;
+		TAILQ_INIT(&sect->kv_list);
+		TAILQ_INSERT_TAIL(&cfg->sect_list, sect, next);
+	}
+	for (i = 0; i < k; ++i)
+		TAILQ_INSERT_TAIL(&((ConfigSection *) sitems[kitems[i].sect].obj)->kv_list,
+				(ConfigKeyValue *) kitems[i].obj, next);
+
+	/* chains are built coldest first, so hottest entries end up at their heads */
+	if (cfg->sect_htab)
+		memset(cfg->sect_htab, 0, cfg->sect_htabsize * sizeof(ConfigSection *));
+	for (i = n - 1; (i >= 0) && cfg->sect_htab; --i) {
+		sect = sorder[i]->obj;
+		sb = &cfg->sect_htab[sect->hash & (cfg->sect_htabsize - 1)];
+		sect->hnext = *sb;
+		*sb = sect;
+	}
+	for (i = k - 1; i >= 0; --i) {
+		kv   = korder[i]->obj;
+		sect = sitems[korder[i]->sect].obj;
+		if (!sect->kv_htab)
+			continue;
+		kb = &sect->kv_htab[kv->hash & (sect->kv_htabsize - 1)];
+		kv->hnext = *kb;
+		*kb = kv;
+	}
+
+	/* objects of previous layouts release their arenas */
+	for (i = 0; i < k; ++i) {
+		kv = kitems[i].old;
+		/* references of interned strings were handed over to the new key-value */
+		if (kv->interned & KV_KEY_INTERNED)
+			kv->key = NULL;
+		if (kv->interned & KV_VALUE_INTERNED)
+			kv->value = NULL;
+		kv->interned = 0;
+		KeyValFree(kv);
+	}
+	for (i = 0; i < n; ++i)
+		SectFree(sitems[i].old);
+
+	MemRecount(cfg);
+
+	ret = CONFIG_OK;
+
+out:
+	free(sitems);
+	free(sorder);
+	free(kitems);
+	free(korder);
+
+	return ret;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * \brief              ConfigInternNew() creates an intern table. Configs using the table
+ *                     (see ConfigSetIntern()) store each distinct key and value string once,
+ *                     so keys read from the same table can be compared by pointer.
+ *
+ * \return             Returns the table on success, NULL on failure.
+ */
+ConfigIntern *ConfigInternNew(void)
+{
+	ConfigIntern *intern;
+
+	if ((intern = calloc(1, sizeof(ConfigIntern))) == NULL)
+		return NULL;
+
+	if ((intern->htab = calloc(INTERN_INIT_SIZE, sizeof(InternStr *))) == NULL) {
+		free(intern);
+		return NULL;
+	}
+
+	pthread_mutex_init(&intern->lock, NULL);
+	intern->htabsize = INTERN_INIT_SIZE;
+	intern->refcnt   = 1;
+
+	return intern;
+}
+
+/**
+ * \brief              ConfigInternFree() drops the handle of the table. The table is freed
+ *                     when no config uses it and none of its strings is referenced anymore.
+ *
+ * \param intern       intern table
+ */
+void ConfigInternFree(ConfigIntern *intern)
+{
+	if (intern)
+		InternUnref(intern);
+}
+
+/**
+ * \brief              ConfigInternGetStats() gets number and size of the strings in the table
+ *
+ * \param intern       intern table
+ * \param stats        statistics to fill
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigInternGetStats(ConfigIntern *intern, ConfigInternStats *stats)
+{
+	if (!intern || !stats)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	pthread_mutex_lock(&intern->lock);
+	*stats = intern->stats;
+	pthread_mutex_unlock(&intern->lock);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigSetIntern() interns keys and values added to cfg from now on in
+ *                     the given table. Strings added before keep their storage. Configs read
+ *                     as includes or directory entries of cfg use the same table.
+ *
+ * \param cfg          config handle
+ * \param intern       intern table, the config keeps a reference of it (NULL: no interning)
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigSetIntern(Config *cfg, ConfigIntern *intern)
+{
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (intern == cfg->intern)
+		return CONFIG_OK;
+
+	if (intern) {
+		pthread_mutex_lock(&intern->lock);
+		++intern->refcnt;
+		pthread_mutex_unlock(&intern->lock);
+	}
+
+	if (cfg->intern)
+		InternUnref(cfg->intern);
+
+	cfg->intern = intern;
+
+	return CONFIG_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static ConfigRet SubIndexRebuild(Config *cfg, unsigned int size)
+{
+	ConfigSubscription **htab, *sub, *t_sub;
+	unsigned int         i;
+
+	if ((htab = calloc(size, sizeof(ConfigSubscription *))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	for (i = 0; i < cfg->sub_htabsize; ++i) {
+		for (sub = cfg->sub_htab[i]; sub; sub = t_sub) {
+			t_sub = sub->hnext;
+			sub->hnext = htab[sub->hash & (size - 1)];
+			htab[sub->hash & (size - 1)] = sub;
+		}
+	}
+
+	free(cfg->sub_htab);
+	cfg->sub_htab = htab;
+	cfg->sub_htabsize = size;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigSubscribe() registers a callback for changes of a key or of
+ *                     keys with a prefix. Changes made by ConfigAddString() (and the other
+ *                     ConfigAdd*() calls), ConfigRemoveKey(), ConfigRemoveSection(),
+ *                     ConfigMerge() into cfg and reads into cfg are reported. Adding a key
+ *                     with its current value is not a change. Changes are coalesced: the
+ *                     callback runs once at the end of each read or update (see
+ *                     ConfigBeginUpdate()), or after each call outside of them.
+ *
+ * \param cfg          config handle
+ * \param section      section of the keys
+ * \param key          key name, or a prefix ending with '*'. NULL is the same as "*"
+ *                     and subscribes to every key of the section
+ * \param callback     function called with cfg, section, key, number of changes and ctx
+ * \param ctx          user data passed to callback
+ *
+ * \return             Returns the subscription on success, NULL on failure.
+ */
+ConfigSubscription *ConfigSubscribe(Config *cfg, const char *section, const char *key,
+		ConfigChangeCallback callback, void *ctx)
+{
+	ConfigSubscription *sub;
+	size_t              len;
+
+	if (!cfg || !callback)
+		return NULL;
+
+	if ( (cfg->numofsubs >= (int) cfg->sub_htabsize) &&
+		 (SubIndexRebuild(cfg, cfg->sub_htabsize ? cfg->sub_htabsize * 2 : HTAB_INIT_SIZE) != CONFIG_OK) )
+		return NULL;
+
+	if ((sub = calloc(1, sizeof(ConfigSubscription))) == NULL)
+		return NULL;
+
+	if ( (section && ((sub->section = strdup(section)) == NULL)) ||
+		 ((sub->key = strdup(key ? key : "*")) == NULL) ) {
+		SubFree(sub);
+		return NULL;
+	}
+
+	len = strlen(sub->key);
+	sub->prefixlen = (len && (sub->key[len - 1] == '*')) ? (int) len - 1 : -1;
+	sub->hash      = SubHash(StrHash(section), StrHash(sub->key), sub->prefixlen >= 0);
+	sub->callback  = callback;
+	sub->ctx       = ctx;
+
+	sub->hnext = cfg->sub_htab[sub->hash & (cfg->sub_htabsize - 1)];
+	cfg->sub_htab[sub->hash & (cfg->sub_htabsize - 1)] = sub;
+	++cfg->numofsubs;
+
+	return sub;
+}
+
+/**
+ * \brief              ConfigUnsubscribe() removes a subscription, it may be called from
+ *                     callbacks
+ *
+ * \param cfg          config handle
+ * \param sub          subscription returned by ConfigSubscribe()
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigUnsubscribe(Config *cfg, ConfigSubscription *sub)
+{
+	ConfigSubscription **pp;
+
+	if (!cfg || !sub || !cfg->sub_htab)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	pp = &cfg->sub_htab[sub->hash & (cfg->sub_htabsize - 1)];
+	while (*pp && (*pp != sub))
+		pp = &(*pp)->hnext;
+	if (*pp == NULL)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*pp = sub->hnext;
+	--cfg->numofsubs;
+	if (sub->pending)
+		TAILQ_REMOVE(&cfg->sub_pending, sub, next);
+	SubFree(sub);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigBeginUpdate() opens an update of cfg. Subscribers are notified
+ *                     of the changes made until the matching ConfigEndUpdate(), once per
+ *                     subscription. Updates may be nested.
+ *
+ * \param cfg          config handle
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigBeginUpdate(Config *cfg)
+{
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	++cfg->txn;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigEndUpdate() closes an update opened by ConfigBeginUpdate(),
+ *                     subscribers are notified when the outermost update is closed
+ *
+ * \param cfg          config handle
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigEndUpdate(Config *cfg)
+{
+	if (!cfg || (cfg->txn <= 0))
+		return CONFIG_ERR_INVALID_PARAM;
+
+	--cfg->txn;
+	SubFlush(cfg);
+
+	return CONFIG_OK;
+}
+
+
+/**
+ * \brief Variable bound to a key by ConfigBind*()
+ */
+typedef struct ConfigBinding
+{
+	enum { BIND_INT, BIND_UINT, BIND_FLOAT, BIND_DOUBLE, BIND_BOOL } type;
+	void *target;
+	union {
+		int          i;
+		unsigned int u;
+		float        f;
+		double       d;
+		bool         b;
+	} dfl;
+} ConfigBinding;
+
+/*
+ * converts the value of the key once per change and stores it to the bound variable,
+ * the default is stored if the key is missing or its value cannot be converted
+ */
+static void BindUpdate(Config *cfg, const char *section, const char *key, int nchanges, void *ctx)
+{
+	ConfigBinding *b = ctx;
+	union {
+		int          i;
+		unsigned int u;
+		float        f;
+		double       d;
+		bool         b;
+	} v;
+
+	(void) nchanges;
+
+	switch (b->type) {
+		case BIND_INT:
+			if (ConfigReadInt(cfg, section, key, &v.i, b->dfl.i) != CONFIG_OK)
+				v.i = b->dfl.i;
+			__atomic_store_n((int *) b->target, v.i, __ATOMIC_RELEASE);
+			break;
+		case BIND_UINT:
+			if (ConfigReadUnsignedInt(cfg, section, key, &v.u, b->dfl.u) != CONFIG_OK)
+				v.u = b->dfl.u;
+			__atomic_store_n((unsigned int *) b->target, v.u, __ATOMIC_RELEASE);
+			break;
+		case BIND_FLOAT:
+			if (ConfigReadFloat(cfg, section, key, &v.f, b->dfl.f) != CONFIG_OK)
+				v.f = b->dfl.f;
+			__atomic_store((float *) b->target, &v.f, __ATOMIC_RELEASE);
+			break;
+		case BIND_DOUBLE:
+			if (ConfigReadDouble(cfg, section, key, &v.d, b->dfl.d) != CONFIG_OK)
+				v.d = b->dfl.d;
+			__atomic_store((double *) b->target, &v.d, __ATOMIC_RELEASE);
+			break;
+		case BIND_BOOL:
+			if (ConfigReadBool(cfg, section, key, &v.b, b->dfl.b) != CONFIG_OK)
+				v.b = b->dfl.b;
+			__atomic_store_n((bool *) b->target, v.b, __ATOMIC_RELEASE);
+			break;
+	}
+}
+
+static ConfigSubscription *Bind(Config *cfg, const char *section, const char *key,
+		const ConfigBinding *binding)
+{
+	ConfigSubscription *sub;
+	ConfigBinding      *b;
+	size_t              len;
+
+	/* a variable holds the value of a single key */
+	if (!cfg || !key || !binding->target || !(len = strlen(key)) || (key[len - 1] == '*'))
+		return NULL;
+
+	if ((b = malloc(sizeof(ConfigBinding))) == NULL)
+		return NULL;
+	*b = *binding;
+
+	if ((sub = ConfigSubscribe(cfg, section, key, BindUpdate, b)) == NULL) {
+		free(b);
+		return NULL;
+	}
+	sub->ownctx = true;
+
+	BindUpdate(cfg, sub->section, sub->key, 0, b);
+
+	return sub;
+}
+
+/**
+ * \brief              ConfigBindInt() binds a variable to the key. The converted value, or
+ *                     dfl_val if the key does not exist or its value is invalid, is stored
+ *                     to the variable atomically now and after every change of the key (see
+ *                     ConfigSubscribe()), so readers do not need to call ConfigReadInt().
+ *
+ * \param cfg          config handle
+ * \param section      section of the key
+ * \param key          key name
+ * \param value        variable to bind, it must be valid until the subscription is removed
+ *                     with ConfigUnsubscribe() or cfg is freed
+ * \param dfl_value    value of the variable when the key is missing or invalid
+ *
+ * \return             Returns the subscription of the variable on success, NULL on failure.
+ */
+ConfigSubscription *ConfigBindInt(Config *cfg, const char *section, const char *key,
+		CONFIG_ATOMIC(int) *value, int dfl_value)
+{
+	ConfigBinding b = { .type = BIND_INT, .target = (void *) value, .dfl.i = dfl_value };
+
+	return Bind(cfg, section, key, &b);
+}
+
+/**
+ * \brief              ConfigBindUnsignedInt() binds a variable to the key, see ConfigBindInt()
+ *
+ * \param cfg          config handle
+ * \param section      section of the key
+ * \param key          key name
+ * \param value        variable to bind
+ * \param dfl_value    value of the variable when the key is missing or invalid
+ *
+ * \return             Returns the subscription of the variable on success, NULL on failure.
+ */
+ConfigSubscription *ConfigBindUnsignedInt(Config *cfg, const char *section, const char *key,
+		CONFIG_ATOMIC(unsigned int) *value, unsigned int dfl_value)
+{
+	ConfigBinding b = { .type = BIND_UINT, .target = (void *) value, .dfl.u = dfl_value };
+
+	return Bind(cfg, section, key, &b);
+}
+
+/**
+ * \brief              ConfigBindFloat() binds a variable to the key, see ConfigBindInt()
+ *
+ * \param cfg          config handle
+ * \param section      section of the key
+ * \param key          key name
+ * \param value        variable to bind
+ * \param dfl_value    value of the variable when the key is missing or invalid
+ *
+ * \return             Returns the subscription of the variable on success, NULL on failure.
+ */
+ConfigSubscription *ConfigBindFloat(Config *cfg, const char *section, const char *key,
+		CONFIG_ATOMIC(float) *value, float dfl_value)
+{
+	ConfigBinding b = { .type = BIND_FLOAT, .target = (void *) value, .dfl.f = dfl_value };
+
+	return Bind(cfg, section, key, &b);
+}
+
+/**
+ * \brief              ConfigBindDouble() binds a variable to the key, see ConfigBindInt()
+ *
+ * \param cfg          config handle
+ * \param section      section of the key
+ * \param key          key name
+ * \param value        variable to bind
+ * \param dfl_value    value of the variable when the key is missing or invalid
+ *
+ * \return             Returns the subscription of the variable on success, NULL on failure.
+ */
+ConfigSubscription *ConfigBindDouble(Config *cfg, const char *section, const char *key,
+		CONFIG_ATOMIC(double) *value, double dfl_value)
+{
+	ConfigBinding b = { .type = BIND_DOUBLE, .target = (void *) value, .dfl.d = dfl_value };
+
+	return Bind(cfg, section, key, &b);
+}
+
+/**
+ * \brief              ConfigBindBool() binds a variable to the key, see ConfigBindInt()
+ *
+ * \param cfg          config handle
+ * \param section      section of the key
+ * \param key          key name
+ * \param value        variable to bind
+ * \param dfl_value    value of the variable when the key is missing or invalid
+ *
+ * \return             Returns the subscription of the variable on success, NULL on failure.
+ */
+ConfigSubscription *ConfigBindBool(Config *cfg, const char *section, const char *key,
+		CONFIG_ATOMIC(bool) *value, bool dfl_value)
+{
+	ConfigBinding b = { .type = BIND_BOOL, .target = (void *) value, .dfl.b = dfl_value };
+
+	return Bind(cfg, section, key, &b);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/* reports every key of sect as added or removed */
+static void DiffSection(const ConfigSection *sect, ConfigDiffType type,
+		ConfigDiffCallback callback, void *arg)
+{
+	ConfigKeyValue *kv;
+
+	TAILQ_FOREACH(kv, &sect->kv_list, next) {
+		if (type == CONFIG_DIFF_ADDED)
+			callback(type, sect->name, kv->key, NULL, kv->value, arg);
+		else
+			callback(type, sect->name, kv->key, kv->value, NULL, arg);
+	}
+}
+
+/**
+ * \brief              ConfigDiff() reports the keys which are added, removed or changed in
+ *                     cfg2 compared to cfg1. Sections whose key count and content digest
+ *                     are equal in both configs are skipped without visiting their keys,
+ *                     so the cost is proportional to the number of sections plus the
+ *                     number of keys in changed sections. The digest is a sum of 64-bit
+ *                     hashes of keys and values, so a changed section is missed only if
+ *                     the sums collide, with a chance of about 2^-64.
+ *
+ * \param cfg1         old config handle
+ * \param cfg2         new config handle
+ * \param callback     function called for each difference. old_val is NULL for added keys,
+ *                     new_val is NULL for removed keys
+ * \param arg          user data passed to callback
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigDiff(const Config *cfg1, const Config *cfg2, ConfigDiffCallback callback, void *arg)
+{
+	ConfigSection  *sect1, *sect2;
+	ConfigKeyValue *kv1, *kv2;
+
+	if (!cfg1 || !cfg2 || !callback)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	TAILQ_FOREACH(sect1, &cfg1->sect_list, next) {
+		if (ConfigGetSection(cfg2, sect1->name, &sect2) != CONFIG_OK) {
+			DiffSection(sect1, CONFIG_DIFF_REMOVED, callback, arg);
+			continue;
+		}
+
+		if ((sect1->numofkv == sect2->numofkv) && (sect1->digest == sect2->digest))
+			continue;
+
+		TAILQ_FOREACH(kv1, &sect1->kv_list, next) {
+			if (ConfigGetKeyValue(cfg2, sect2, kv1->key, &kv2) != CONFIG_OK)
+				callback(CONFIG_DIFF_REMOVED, sect1->name, kv1->key, kv1->value, NULL, arg);
+			else if (!KeyValSameValue(kv1, kv2))
+				callback(CONFIG_DIFF_CHANGED, sect1->name, kv1->key, kv1->value, kv2->value, arg);
+		}
+
+		TAILQ_FOREACH(kv2, &sect2->kv_list, next) {
+			if (ConfigGetKeyValue(cfg1, sect1, kv2->key, &kv1) != CONFIG_OK)
+				callback(CONFIG_DIFF_ADDED, sect2->name, kv2->key, NULL, kv2->value, arg);
+		}
+	}
+
+	TAILQ_FOREACH(sect2, &cfg2->sect_list, next) {
+		if (ConfigGetSection(cfg1, sect2->name, &sect1) != CONFIG_OK)
+			DiffSection(sect2, CONFIG_DIFF_ADDED, callback, arg);
+	}
+
+	return CONFIG_OK;
+}
+
+
+/* unlinks kv from ssect and links it to the end of dsect without copying */
+static void MoveKeyValue(const Config *dst, ConfigSection *dsect, ConfigSection *ssect,
+		ConfigKeyValue *kv)
+{
+	MemKeyVal(ssect, kv, -1);
+	KeyValIndexRemove(ssect, kv);
+	TAILQ_REMOVE(&ssect->kv_list, kv, next);
+	--(ssect->numofkv);
+	ssect->digest -= kv->digest;
+
+	TAILQ_INSERT_TAIL(&dsect->kv_list, kv, next);
+	++(dsect->numofkv);
+	KeyValIndexInsert(dst, dsect, kv);
+	dsect->digest += kv->digest;
+	MemKeyVal(dsect, kv, 1);
+}
+
+/* unlinks sect from src and links it to the end of dst without copying */
+static void MoveSection(Config *dst, Config *src, ConfigSection *sect)
+{
+	size_t *from = (size_t *) &src->mem;
+	size_t *to   = (size_t *) &dst->mem;
+	size_t *m    = (size_t *) &sect->mem;
+	size_t  i;
+
+	for (i = 0; i < sizeof(ConfigMemStats) / sizeof(size_t); ++i) {
+		from[i] -= m[i];
+		to[i]   += m[i];
+	}
+	sect->cfg = dst;
+
+	SectIndexRemove(src, sect);
+	TAILQ_REMOVE(&src->sect_list, sect, next);
+	--(src->numofsect);
+
+	TAILQ_INSERT_TAIL(&dst->sect_list, sect, next);
+	++(dst->numofsect);
+	SectIndexInsert(dst, sect);
+
+	SubNotifySection(dst, sect);
+}
+
+/* unlinks kv from ssect and puts it in place of dkv of dsect, which is removed */
+static void ReplaceKeyValue(const Config *dst, ConfigSection *dsect, ConfigKeyValue *dkv,
+		ConfigSection *ssect, ConfigKeyValue *kv)
+{
+	MemKeyVal(ssect, kv, -1);
+	KeyValIndexRemove(ssect, kv);
+	TAILQ_REMOVE(&ssect->kv_list, kv, next);
+	--(ssect->numofkv);
+	ssect->digest -= kv->digest;
+
+	TAILQ_INSERT_AFTER(&dsect->kv_list, dkv, kv, next);
+	++(dsect->numofkv);
+	KeyValIndexInsert(dst, dsect, kv);
+	dsect->digest += kv->digest;
+	MemKeyVal(dsect, kv, 1);
+
+	_ConfigRemoveKey(dsect, dkv);
+}
+
+/* moves key-values of ssect into dsect, conflicts must have been checked by caller */
+static void MergeSection(Config *dst, ConfigSection *dsect, ConfigSection *ssect,
+		ConfigMergePolicy policy)
+{
+	ConfigKeyValue *kv, *t_kv, *dkv;
+
+	TAILQ_FOREACH_SAFE(kv, &ssect->kv_list, next, t_kv) {
+		if (ConfigGetKeyValue(NULL, dsect, kv->key, &dkv) != CONFIG_OK) {
+			MoveKeyValue(dst, dsect, ssect, kv);
+			SubNotify(dst, dsect, kv);
+			continue;
+		}
+
+		if (policy != CONFIG_MERGE_OVERWRITE)
+			continue;
+
+		if (!KeyValSameValue(kv, dkv))
+			SubNotify(dst, dsect, dkv);
+
+		/* a value placed by ConfigRelayout() lives as long as kv, so kv replaces dkv */
+		if (ArenaOwns(kv->arena, kv->value)) {
+			ReplaceKeyValue(dst, dsect, dkv, ssect, kv);
+			continue;
+		}
+
+		/* adopt the value string of kv */
+		dsect->digest -= dkv->digest;
+		MemValue(dsect, dkv, -1);
+		KeyValFreeValue(dkv);
+		MemValue(ssect, kv, -1);
+		dkv->value  = kv->value;
+		dkv->vhash  = kv->vhash;
+		dkv->digest = kv->digest;
+		dkv->interned |= kv->interned & KV_VALUE_INTERNED;
+		dsect->digest += dkv->digest;
+		MemValue(dsect, dkv, 1);
+
+		ssect->digest -= kv->digest;
+		kv->value = NULL;
+		kv->interned &= ~KV_VALUE_INTERNED;
+		_ConfigRemoveKey(ssect, kv);
+	}
+}
+
+/**
+ * \brief              ConfigMerge() merges all sections and key-values of src into dst.
+ *                     Nodes and strings are moved from src instead of being copied; sections
+ *                     which do not exist in dst are spliced as a whole. src stays a valid
+ *                     handle holding only the entries which are not taken over and must
+ *                     still be freed by the caller.
+ *                     Unlike ConfigAddString(), moved keys are not checked against the schema
+ *                     set on dst by ConfigSetSchema(), nor are its required keys: values are
+ *                     expected to be checked when src was built with the same schema, as the
+ *                     readers merging included files and directory fragments do.
+ *
+ * \param dst          config handle to merge into
+ * \param src          config handle to merge from
+ * \param policy       what to do when a key exists in both handles:
+ *                     CONFIG_MERGE_OVERWRITE takes the value of src,
+ *                     CONFIG_MERGE_KEEP keeps the value of dst,
+ *                     CONFIG_MERGE_ERROR fails with CONFIG_ERR_CONFLICT if the values differ
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error and
+ *                     nothing is merged.
+ */
+ConfigRet ConfigMerge(Config *dst, Config *src, ConfigMergePolicy policy)
+{
+	ConfigSection  *sect, *t_sect, *dsect;
+	ConfigKeyValue *kv, *dkv;
+	ConfigRet       ret;
+
+	if (!dst || !src || (dst == src))
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (policy == CONFIG_MERGE_ERROR) {
+		TAILQ_FOREACH(sect, &src->sect_list, next) {
+			if (ConfigGetSection(dst, sect->name, &dsect) != CONFIG_OK)
+				continue;
+
+			TAILQ_FOREACH(kv, &sect->kv_list, next) {
+				if ( (ConfigGetKeyValue(dst, dsect, kv->key, &dkv) == CONFIG_OK) &&
+					 !KeyValSameValue(kv, dkv) )
+					return CONFIG_ERR_CONFLICT;
+			}
+		}
+	}
+
+	/*
+	 * src must keep its default section, so it is merged rather than spliced. The only
+	 * allocation that can fail is done here, before anything is moved
+	 */
+	if ( (ConfigGetSection(src, CONFIG_SECTION_FLAT, &sect) == CONFIG_OK) &&
+		 (ConfigGetSection(dst, CONFIG_SECTION_FLAT, &dsect) != CONFIG_OK) &&
+		 ((ret = ConfigAddSection(dst, CONFIG_SECTION_FLAT, NULL)) != CONFIG_OK) )
+		return ret;
+
+	TAILQ_FOREACH_SAFE(sect, &src->sect_list, next, t_sect) {
+		if (ConfigGetSection(dst, sect->name, &dsect) != CONFIG_OK)
+			MoveSection(dst, src, sect);
+		else
+			MergeSection(dst, dsect, sect, policy);
+	}
+
+	SubFlush(dst);
+
+	return CONFIG_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * \brief              Gets section name on the buffer p
+ *
+ * \param cfg          config handle
+ * \param p            read buffer
+ * \param section      pointer address to section
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+static ConfigRet GetSectName(const Config *cfg, char *p, char **section)
+{
+	char *q, *r;
+
+	if (!cfg || !p || !*p || !section)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*section = NULL;
+
+	/* get section name */
+	while (*p && isspace(*p))
+		++p;
+
+	if (*p != '[')
+		return CONFIG_ERR_PARSING;
+
+	++p;
+	while (*p && isspace(*p))
+		++p;
+
+	for (q = p;
+		 *q && (*q != '\r') && (*q != '\n') && (*q != ']') && !strchr(cfg->comment_chars, *q);
+		 ++q)
+		;
+
+	if (*q != ']')
+		return CONFIG_ERR_PARSING;
+
+	r = q + 1;
+
+	while (*q && (q > p) && isspace(*(q - 1)))
+		--q;
+
+	if (q == p) /* section has no name */
+		return CONFIG_ERR_PARSING;
+
+	*q = '\0';
+	*section = p;
+
+	/* check rest of section */
+	while (*r && isspace(*r))
+		++r;
+
+	/* there are unrecognized trailing data */
+	if (*r && !strchr(cfg->comment_chars, *r))
+		return CONFIG_ERR_PARSING;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              Gets key and value on the buffer p
+ *
+ * \param cfg          config handle
+ * \param p            read buffer
+ * \param key          pointer address to key
+ * \param val          pointer address to value
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+static ConfigRet GetKeyVal(const Config *cfg, char *p, char **key, char **val)
+{
+	char *q, *v;
+
+	if (!cfg || !p || !*p || !key || !val)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*key = *val = NULL;
+
+	/* get key */
+	while (*p && isspace(*p))
+		++p;
+
+	for (q = p;
+		 *q && (*q != '\r') && (*q != '\n') && (*q != cfg->keyval_sep) && !strchr(cfg->comment_chars, *q);
+		 ++q)
+		;
+
+	if (*q != cfg->keyval_sep)
+		return CONFIG_ERR_PARSING;
+
+	v = q + 1;
+
+	while (*q && (q > p) && isspace(*(q - 1)))
+		--q;
+
+	if (q == p) /* no key name */
+		return CONFIG_ERR_PARSING;
+
+	*q = '\0';
+	*key = p;
+
+	/* get value */
+	while (*v && isspace(*v))
+		++v;
+
+	for (q = v;
+		 *q && (*q != '\r') && (*q != '\n') && !strchr(cfg->comment_chars, *q);
+		 ++q)
+		;
+
+	while (*q && (q > v) && isspace(*(q - 1)))
+		--q;
+
+	if (q == v) /* no value */
+		return CONFIG_ERR_INVALID_VALUE;
+
+	*q = '\0';
+	*val = v;
+
+	return CONFIG_OK;
+}
+
+static bool IsIncludeDirective(const char *p)
+{
+	return ( !strncmp(p, INCLUDE_DIRECTIVE, sizeof(INCLUDE_DIRECTIVE) - 1) &&
+			 isspace(p[sizeof(INCLUDE_DIRECTIVE) - 1]) );
+}
+
+/**
+ * \brief              Gets path of an include directive (@include path) on the buffer p.
+ *                     Path may be quoted with double quotes to contain spaces.
+ *
+ * \param cfg          config handle
+ * \param p            read buffer
+ * \param path         pointer address to path
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+static ConfigRet GetIncludePath(const Config *cfg, char *p, char **path)
+{
+	char *q;
+
+	if (!cfg || !p || !*p || !path)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*path = NULL;
+
+	while (*p && isspace(*p))
+		++p;
+
+	if (strncmp(p, INCLUDE_DIRECTIVE, sizeof(INCLUDE_DIRECTIVE) - 1))
+		return CONFIG_ERR_PARSING;
+
+	p += sizeof(INCLUDE_DIRECTIVE) - 1;
+	if (!isspace(*p))
+		return CONFIG_ERR_PARSING;
+
+	while (*p && isspace(*p))
+		++p;
+
+	if (*p == '"') {
+		for (q = ++p; *q && (*q != '"') && (*q != '\r') && (*q != '\n'); ++q)
+			;
+		if (*q != '"')
+			return CONFIG_ERR_PARSING;
+		*q++ = '\0';
+	}
+	else {
+		for (q = p; *q && !isspace(*q) && !strchr(cfg->comment_chars, *q); ++q)
+			;
+		if (*q)
+			*q++ = '\0';
+	}
+
+	if (!*p) /* no path */
+		return CONFIG_ERR_PARSING;
+
+	/* check rest of directive */
+	while (*q && isspace(*q))
+		++q;
+
+	if (*q && !strchr(cfg->comment_chars, *q))
+		return CONFIG_ERR_PARSING;
+
+	*path = p;
+
+	return CONFIG_OK;
+}
+
+/* ConfigParseStream(), the number of the line being parsed is kept in lineno if not NULL */
+static ConfigRet ParseStream(FILE *fp, const Config *cfg, const ConfigHandlers *handlers, void *arg,
+		int *lineno);
+
+/**
+ * \brief              ConfigParseStream() parses the stream without building a config and
+ *                     calls the handlers for each section header, key-value and include
+ *                     directive in the order they appear. Strings passed to handlers are
+ *                     NUL terminated views into the line buffer and are valid only during
+ *                     the call. Memory use does not depend on the size of the stream.
+ *
+ * \param fp           FILE handle to read
+ * \param cfg          config handle whose settings (comment chars, separator) are used,
+ *                     NULL for default settings
+ * \param handlers     handlers to call, any of them may be NULL. If a handler returns
+ *                     other than CONFIG_OK, parsing stops and that value is returned.
+ * \param arg          user data passed to handlers
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigParseStream(FILE *fp, const Config *cfg, const ConfigHandlers *handlers, void *arg)
+{
+	return ParseStream(fp, cfg, handlers, arg, NULL);
+}
+
+static ConfigRet ParseStream(FILE *fp, const Config *cfg, const ConfigHandlers *handlers, void *arg,
+		int *lineno)
+{
+	char      *p       = NULL;
+	char      *section = NULL;
+	char      *key     = NULL;
+	char      *val     = NULL;
+	char      *path    = NULL;
+	char       buf[4096];
+	int        line    = 0;
+	size_t     bytes   = 0;
+	bool       eol     = true;
+	unsigned long long t;
+	ConfigRet  ret     = CONFIG_OK;
+
+	if ( !fp || !handlers || (cfg && (cfg->initnum != CONFIG_INIT_MAGIC)) )
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (cfg == NULL)
+		cfg = &DefaultSettings;
+
+	while (!feof(fp)) {
+		t = TimingStart(cfg);
+		p = fgets(buf, sizeof(buf), fp);
+		TIMING_ADD(cfg, io_ns, t);
+		if (p == NULL)
+			continue;
+
+		/* a line longer than buffer is read in pieces */
+		if (eol)
+			++line;
+		if (lineno)
+			*lineno = line;
+		eol = (strchr(buf, '\n') != NULL);
+		if (cfg->stats)
+			bytes += strlen(buf);
+
+		for (p = buf; *p && isspace(*p) ; ++p)
+			;
+		if (!*p || strchr(cfg->comment_chars, *p))
+			continue;
+
+		if (*p == '[') {
+			t = TimingStart(cfg);
+			ret = GetSectName(cfg, p, &section);
+			TIMING_ADD(cfg, tokenize_ns, t);
+			if (ret != CONFIG_OK)
+				break;
+
+			PROBE2(section, section, line);
+
+			if ( handlers->on_section &&
+				 ((ret = handlers->on_section(arg, section, strlen(section))) != CONFIG_OK) )
+				break;
+		}
+		else if (IsIncludeDirective(p)) {
+			t = TimingStart(cfg);
+			ret = GetIncludePath(cfg, p, &path);
+			TIMING_ADD(cfg, tokenize_ns, t);
+			if (ret != CONFIG_OK)
+				break;
+
+			if ( handlers->on_include &&
+				 ((ret = handlers->on_include(arg, path, strlen(path))) != CONFIG_OK) )
+				break;
+		}
+		else {
+			t = TimingStart(cfg);
+			ret = GetKeyVal(cfg, p, &key, &val);
+			TIMING_ADD(cfg, tokenize_ns, t);
+			if (ret != CONFIG_OK)
+				break;
+
+			PROBE3(keyval, key, val, line);
+
+			if ( handlers->on_keyval &&
+				 ((ret = handlers->on_keyval(arg, key, strlen(key), val, strlen(val))) != CONFIG_OK) )
+				break;
+		}
+	}
+
+	if ((ret != CONFIG_OK) && handlers->on_error)
+		handlers->on_error(arg, line, ret);
+
+	STAT_ADD(cfg, lines_parsed, line);
+	STAT_ADD(cfg, bytes_parsed, bytes);
+
+	return ret;
+}
+
+/**
+ * \brief              Files being read, innermost first, for include cycle detection
+ */
+typedef struct IncludeChain
+{
+	const char                *path;      /* canonical path */
+	const struct IncludeChain *parent;
+} IncludeChain;
+
+/**
+ * \brief              Included file which is read on a worker thread while the including
+ *                     file is parsed. Content of the including file after the directive is
+ *                     collected in rest, which is applied after the included file.
+ */
+typedef struct IncludeJob
+{
+	char               *name;             /* path as written in the directive */
+	char               *path;             /* path as resolved against the including file */
+	char               *sect;             /* section of the directive, NULL for default section */
+	int                 line;             /* line of the directive */
+	Config             *cfg;
+	Config             *rest;
+	ConfigRet           ret;
+	const IncludeChain *chain;
+	pthread_t           tid;
+	bool                started;
+} IncludeJob;
+
+/* include workers running in the process, nested includes share the MAX_THREADS limit */
+static int include_threads;
+
+static ConfigRet ConfigReadChained(FILE *fp, Config **cfg, const char *dir, const IncludeChain *chain);
+
+/* relative paths are relative to directory of including file */
+static char *ResolveIncludePath(const char *dir, const char *path)
+{
+	char *s;
+
+	if (!dir || (*path == '/'))
+		return strdup(path);
+
+	if ((s = malloc(strlen(dir) + strlen(path) + 2)) != NULL)
+		sprintf(s, "%s/%s", dir, path);
+
+	return s;
+}
+
+/* content of filename is read from data if it is not NULL (already loaded) */
+static ConfigRet ConfigReadFileChained(const char *filename, char *data, size_t size,
+		Config **cfg, const IncludeChain *parent)
+{
+	FILE               *fp  = NULL;
+	char               *dir = NULL;
+	char               *p   = NULL;
+	char                path[PATH_MAX];
+	char                iobuf[FILE_BUF_SIZE];
+	IncludeChain        node;
+	const IncludeChain *c;
+	unsigned long long  t;
+	ConfigRet           ret = CONFIG_OK;
+
+	if (realpath(filename, path) == NULL)
+		return CONFIG_ERR_FILE;
+
+	for (c = parent; c; c = c->parent) {
+		if (!strcmp(c->path, path))
+			return CONFIG_ERR_PARSING;
+	}
+
+	node.path = path;
+	node.parent = parent;
+
+	if ((dir = strdup(path)) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+	if ((p = strrchr(dir, '/')) != NULL)
+		*p = '\0';
+
+	t = (*cfg) ? TimingStart(*cfg) : 0;
+	if (data)
+		fp = fmemopen(data, size, "r");
+	else if ((fp = fopen(filename, "r")) != NULL)
+		setvbuf(fp, iobuf, _IOFBF, sizeof(iobuf));  /* saves stdio buffer allocation per file */
+	if (*cfg)
+		TIMING_ADD(*cfg, io_ns, t);
+
+	if (fp == NULL) {
+		free(dir);
+		return CONFIG_ERR_FILE;
+	}
+
+	ret = ConfigReadChained(fp, cfg, dir, &node);
+
+	fclose(fp);
+	free(dir);
+
+	return ret;
+}
+
+static void *IncludeWorker(void *arg)
+{
+	IncludeJob *job = arg;
+
+	job->ret = ConfigReadFileChained(job->path, NULL, 0, &job->cfg, job->chain);
+	__atomic_sub_fetch(&include_threads, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+/* starts reading job on a worker thread unless all workers of the process are busy */
+static bool IncludeStart(IncludeJob *job)
+{
+	if (__atomic_add_fetch(&include_threads, 1, __ATOMIC_ACQUIRE) <= MAX_THREADS)
+		job->started = (pthread_create(&job->tid, NULL, IncludeWorker, job) == 0);
+	if (!job->started)
+		__atomic_sub_fetch(&include_threads, 1, __ATOMIC_RELEASE);
+
+	return job->started;
+}
+
+static void IncludeFree(IncludeJob *job)
+{
+	if (job->started)
+		pthread_join(job->tid, NULL);
+	ConfigFree(job->cfg);
+	ConfigFree(job->rest);
+	free(job->name);
+	free(job->path);
+	free(job->sect);
+	free(job);
+}
+
+/**
+ * \brief              Moves content of an included file into cfg. Keys which are not
+ *                     under a section in the included file are added to the current section.
+ */
+static void SpliceInclude(Config *cfg, ConfigSection *cursect, Config *inc)
+{
+	ConfigSection *sect, *t_sect, *dsect;
+
+	TAILQ_FOREACH_SAFE(sect, &inc->sect_list, next, t_sect) {
+		if (!sect->name)
+			MergeSection(cfg, cursect, sect, CONFIG_MERGE_OVERWRITE);
+		else if (ConfigGetSection(cfg, sect->name, &dsect) == CONFIG_OK)
+			MergeSection(cfg, dsect, sect, CONFIG_MERGE_OVERWRITE);
+		else
+			MoveSection(cfg, inc, sect);
+	}
+}
+
+/**
+ * \brief              State of ConfigRead() while the config is built from parser events
+ */
+typedef struct ReadState
+{
+	Config             *cfg;
+	Config             *target;           /* cfg, or rest of the last include */
+	ConfigSection      *sect;             /* current section of target */
+	const char         *dir;              /* directory of file being read */
+	const IncludeChain *chain;
+	IncludeJob        **jobs;             /* includes in the order of their directives */
+	int                 numofjobs;
+	int                 size;
+	int                 line;             /* line being parsed */
+	bool                schema_failed;    /* a key is rejected by the schema */
+} ReadState;
+
+static ConfigRet ReadOnSection(void *arg, const char *sect, int sect_len)
+{
+	ReadState          *rs = arg;
+	unsigned long long  t  = TimingStart(rs->cfg);
+	ConfigRet           ret;
+
+	ret = ConfigAddSection(rs->target, sect, &rs->sect);
+	TIMING_ADD(rs->cfg, section_ns, t);
+
+	return ret;
+}
+
+static ConfigRet ReadOnKeyVal(void *arg, const char *key, int key_len, const char *val, int val_len)
+{
+	ReadState          *rs = arg;
+	unsigned long long  t  = TimingStart(rs->cfg);
+	ConfigRet           ret;
+
+	ret = ConfigAddString(rs->target, rs->sect->name, key, val);
+	TIMING_ADD(rs->cfg, insert_ns, t);
+
+	if ((ret == CONFIG_ERR_INVALID_VALUE) && rs->target->schema)
+		rs->schema_failed = true;
+
+	return ret;
+}
+
+/* starts reading the included file, the including file continues into the rest of the job */
+static ConfigRet ReadOnInclude(void *arg, const char *path, int path_len)
+{
+	ReadState     *rs  = arg;
+	IncludeJob    *job = NULL;
+	IncludeJob   **t;
+	ConfigSection *sect;
+	int            size;
+	ConfigRet      ret = CONFIG_OK;
+
+	if (rs->numofjobs == rs->size) {
+		size = rs->size ? rs->size * 2 : 8;
+		if ((t = realloc(rs->jobs, size * sizeof(IncludeJob *))) == NULL)
+			return CONFIG_ERR_MEMALLOC;
+		rs->jobs = t;
+		rs->size = size;
+	}
+
+	if ((job = calloc(1, sizeof(IncludeJob))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	job->line  = rs->line;
+	job->chain = rs->chain;
+	if ( ((job->name = strdup(path)) == NULL) ||
+		 ((job->path = ResolveIncludePath(rs->dir, path)) == NULL) ||
+		 (rs->sect->name && ((job->sect = strdup(rs->sect->name)) == NULL)) ||
+		 ((job->cfg = ConfigNew()) == NULL) ||
+		 ((job->rest = ConfigNew()) == NULL) )
+		ret = CONFIG_ERR_MEMALLOC;
+	else if ( ((ret = ConfigCopySettings(job->cfg, rs->cfg)) == CONFIG_OK) &&
+			  ((ret = ConfigCopySettings(job->rest, rs->cfg)) == CONFIG_OK) )
+		ret = ConfigAddSection(job->rest, job->sect, &sect);
+
+	if (ret != CONFIG_OK) {
+		IncludeFree(job);
+		return ret;
+	}
+
+	/* read by the calling thread after the stream if no worker is free */
+	IncludeStart(job);
+	rs->jobs[rs->numofjobs++] = job;
+	rs->target = job->rest;
+	rs->sect = sect;
+
+	return CONFIG_OK;
+}
+
+/* adds the line of the rejected key to the schema error */
+static void ReadOnError(void *arg, int line, ConfigRet ret)
+{
+	ReadState *rs = arg;
+
+	if (rs->schema_failed && rs->target->schema_err)
+		SchemaError(rs->cfg, "line %d: %s", line, rs->target->schema_err);
+}
+
+/**
+ * \brief              Waits for the included files and moves them into cfg in the order of
+ *                     their directives, each followed by the rest of the including file.
+ *                     All directives precede the line the parser failed on, so a failing
+ *                     include is reported instead of ret and what follows it is dropped.
+ *
+ * \return             Returns ret of the parser if all includes are read, otherwise the
+ *                     error of the first failing include.
+ */
+static ConfigRet ReadIncludes(ReadState *rs, ConfigRet ret)
+{
+	IncludeJob    *job;
+	ConfigSection *sect;
+	int            i;
+
+	for (i = 0; i < rs->numofjobs; ++i) {
+		job = rs->jobs[i];
+		if (!job->started && !IncludeStart(job))
+			job->ret = ConfigReadFileChained(job->path, NULL, 0, &job->cfg, job->chain);
+	}
+
+	for (i = 0; i < rs->numofjobs; ++i) {
+		job = rs->jobs[i];
+		if (job->started) {
+			pthread_join(job->tid, NULL);
+			job->started = false;
+		}
+
+		if (job->ret != CONFIG_OK) {
+			if (job->cfg && job->cfg->schema_err)
+				SchemaError(rs->cfg, "line %d: %s: %s", job->line, job->name, job->cfg->schema_err);
+			else if (rs->schema_failed) {
+				free(rs->cfg->schema_err);
+				rs->cfg->schema_err = NULL;
+			}
+			return job->ret;
+		}
+
+		if ((job->ret = ConfigAddSection(rs->cfg, job->sect, &sect)) != CONFIG_OK)
+			return job->ret;
+		SpliceInclude(rs->cfg, sect, job->cfg);
+		StatsAbsorb(rs->cfg, job->cfg);
+
+		if ((job->ret = ConfigMerge(rs->cfg, job->rest, CONFIG_MERGE_OVERWRITE)) != CONFIG_OK)
+			return job->ret;
+		StatsAbsorb(rs->cfg, job->rest);
+	}
+
+	return ret;
+}
+
+static ConfigRet ConfigReadChained(FILE *fp, Config **cfg, const char *dir, const IncludeChain *chain)
+{
+	ConfigHandlers handlers = { ReadOnSection, ReadOnKeyVal, ReadOnInclude, ReadOnError };
+	ReadState      rs;
+	Config        *_cfg    = NULL;
+	int            i;
+	bool           newcfg  = false;
+	ConfigRet      ret     = CONFIG_OK;
+
+	if ( !fp || !cfg || (*cfg && ((*cfg)->initnum != CONFIG_INIT_MAGIC)) )
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (*cfg == NULL) {
+		_cfg = ConfigNew();
+		if (_cfg == NULL)
+			return CONFIG_ERR_MEMALLOC;
+		*cfg = _cfg;
+		newcfg = true;
+	}
+	else
+		_cfg = *cfg;
+
+	memset(&rs, 0, sizeof(rs));
+	rs.cfg = _cfg;
+	rs.target = _cfg;
+	rs.dir = dir;
+	rs.chain = chain;
+
+	/* subscribers are notified once after the whole read */
+	++_cfg->txn;
+
+	/* keys before the first section belong to default section */
+	if ((ret = ConfigAddSection(_cfg, CONFIG_SECTION_FLAT, &rs.sect)) == CONFIG_OK)
+		ret = ParseStream(fp, _cfg, &handlers, &rs, &rs.line);
+
+	ret = ReadIncludes(&rs, ret);
+
+	for (i = 0; i < rs.numofjobs; ++i)
+		IncludeFree(rs.jobs[i]);
+	free(rs.jobs);
+
+	if ((ret == CONFIG_OK) && _cfg->schema && !_cfg->nested)
+		ret = SchemaCheckRequired(_cfg);
+
+	--_cfg->txn;
+	SubFlush(_cfg);
+
+	if ((ret != CONFIG_OK) && newcfg) {
+		ConfigFree(_cfg);
+		*cfg = NULL;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief              ConfigRead() reads the stream and populates the entire content to cfg handle.
+ *                     "@include path" lines are replaced with the content of the given file.
+ *                     Relative include paths are relative to the current directory.
+ *                     Included files are read on worker threads while the stream is parsed.
+ *
+ * \param fp           FILE handle to read
+ * \param cfg          pointer to config handle.
+ *                     If not NULL a handle created with ConfigNew() must be given.
+ *                     If cfg is NULL a new one is created and saved to cfg.
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigRead(FILE *fp, Config **cfg)
+{
+	ConfigRet ret;
+
+	PROBE2(read__start, NULL, fp);
+	ret = ConfigReadChained(fp, cfg, NULL, NULL);
+	PROBE2(read__done, NULL, ret);
+
+	return ret;
+}
+
+/**
+ * \brief              ConfigReadFile() opens and reads the file and populates the
+ *                     entire content to cfg handle. Relative include paths are relative
+ *                     to the directory of the file, include cycles are reported as
+ *                     CONFIG_ERR_PARSING.
+ *
+ * \param filename     name of file to open and load
+ * \param cfg          pointer to config handle.
+ *                     If not NULL a handle created with ConfigNew() must be given.
+ *                     If cfg is NULL a new one is created and saved to cfg.
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadFile(const char *filename, Config **cfg)
+{
+	ConfigRet ret;
+
+	if ( !filename || !cfg || (*cfg && ((*cfg)->initnum != CONFIG_INIT_MAGIC)) )
+		return CONFIG_ERR_INVALID_PARAM;
+
+	PROBE2(read__start, filename, NULL);
+	ret = ConfigReadFileChained(filename, NULL, 0, cfg, NULL);
+	PROBE2(read__done, filename, ret);
+
+	return ret;
+}
+
+static ConfigRet ReadWithTiming(FILE *fp, const char *filename, Config **cfg, ConfigTiming *timing)
+{
+	Config             *_cfg;
+	unsigned long long  t;
+	ConfigRet           ret;
+
+	if ( !cfg || !timing || (*cfg && ((*cfg)->initnum != CONFIG_INIT_MAGIC)) )
+		return CONFIG_ERR_INVALID_PARAM;
+
+	memset(timing, 0, sizeof(ConfigTiming));
+	t = NowNs();
+
+	if ((_cfg = *cfg) == NULL) {
+		if ((_cfg = ConfigNew()) == NULL)
+			return CONFIG_ERR_MEMALLOC;
+	}
+
+	_cfg->timing = timing;
+	ret = filename ? ConfigReadFile(filename, &_cfg) : ConfigRead(fp, &_cfg);
+	_cfg->timing = NULL;
+
+	if (*cfg == NULL) {
+		if (ret == CONFIG_OK)
+			*cfg = _cfg;
+		else
+			ConfigFree(_cfg);
+	}
+
+	timing->total_ns = NowNs() - t;
+
+	return ret;
+}
+
+/**
+ * \brief              ConfigReadWithTiming() is ConfigRead() which also reports the time
+ *                     spent in each phase of the read. Times of included files are added,
+ *                     including those read ahead on other threads, so phases may sum up
+ *                     to more than total_ns.
+ *
+ * \param fp           FILE handle to read
+ * \param cfg          pointer to config handle, as of ConfigRead()
+ * \param timing       phase times to save in
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadWithTiming(FILE *fp, Config **cfg, ConfigTiming *timing)
+{
+	if (!fp)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	return ReadWithTiming(fp, NULL, cfg, timing);
+}
+
+/**
+ * \brief              ConfigReadFileWithTiming() is ConfigReadFile() which also reports the
+ *                     time spent in each phase of the read, see ConfigReadWithTiming()
+ *
+ * \param filename     name of file to open and load
+ * \param cfg          pointer to config handle, as of ConfigReadFile()
+ * \param timing       phase times to save in
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadFileWithTiming(const char *filename, Config **cfg, ConfigTiming *timing)
+{
+	if (!filename)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	return ReadWithTiming(NULL, filename, cfg, timing);
+}
+
+typedef struct FileBatch
+{
+	const char **paths;
+	Config     **cfgs;
+	ConfigRet   *rets;
+} FileBatch;
+
+static void ReadBatchFile(void *arg, int idx)
+{
+	FileBatch *batch = arg;
+
+	batch->rets[idx] = ConfigReadFile(batch->paths[idx], &batch->cfgs[idx]);
+}
+
+/**
+ * \brief              ConfigReadFiles() reads many independent files concurrently, each into
+ *                     its own config handle. Files are handed out to the worker threads one
+ *                     at a time, so a few large files do not hold up the rest.
+ *
+ * \param paths        names of files to open and load
+ * \param n            number of files
+ * \param cfgs         array of n config handles. Each one is treated as in ConfigReadFile():
+ *                     if not NULL a handle created with ConfigNew() must be given,
+ *                     if NULL a new one is created and saved to it.
+ * \param rets         array of n to save result of each file, or NULL if not needed
+ * \param nthreads     number of threads to use, 0 for number of online CPUs
+ *
+ * \return             Returns CONFIG_RET_OK if all files are read, otherwise the error of
+ *                     the first failed file.
+ */
+ConfigRet ConfigReadFiles(const char **paths, int n, Config **cfgs, ConfigRet *rets, int nthreads)
+{
+	FileBatch  batch;
+	ConfigRet *_rets = rets;
+	ConfigRet  ret   = CONFIG_OK;
+	int        i;
+
+	if (!paths || !cfgs || (n < 0))
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if (n == 0)
+		return CONFIG_OK;
+
+	if (!_rets && ((_rets = malloc(n * sizeof(ConfigRet))) == NULL))
+		return CONFIG_ERR_MEMALLOC;
+
+	batch.paths = paths;
+	batch.cfgs  = cfgs;
+	batch.rets  = _rets;
+
+	RunParallel(n, nthreads, ReadBatchFile, &batch);
+
+	for (i = 0; i < n; ++i) {
+		if (_rets[i] != CONFIG_OK) {
+			ret = _rets[i];
+			break;
+		}
+	}
+
+	if (_rets != rets)
+		free(_rets);
+
+	return ret;
+}
+
+typedef struct DirFragment
+{
+	char      *path;
+	Config    *cfg;
+	ConfigRet  ret;
+} DirFragment;
+
+static void ReadFragment(void *arg, int idx)
+{
+	DirFragment *frag = (DirFragment *) arg + idx;
+
+	frag->ret = ConfigReadFile(frag->path, &frag->cfg);
+}
+
+static int CompareFragments(const void *p1, const void *p2)
+{
+	return strcmp(((const DirFragment *) p1)->path, ((const DirFragment *) p2)->path);
+}
+
+/**
+ * \brief              ConfigReadDirectory() reads the fragment files in a directory (conf.d)
+ *                     concurrently and merges them into cfg in lexical filename order, so
+ *                     keys of later files override the ones of earlier files. If any file
+ *                     fails, cfg is left untouched. Required keys of the schema are checked
+ *                     after the merge; if one is missing a given cfg keeps the merged keys,
+ *                     a newly created one is freed and cfg stays NULL.
+ *
+ * \param path         directory to read
+ * \param pattern      shell wildcard pattern (as "*.conf") filenames must match,
+ *                     NULL to read all files. Hidden files are always skipped.
+ * \param cfg          pointer to config handle.
+ *                     If not NULL a handle created with ConfigNew() must be given,
+ *                     its settings are used for parsing the fragments.
+ *                     If cfg is NULL a new one is created and saved to cfg.
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadDirectory(const char *path, const char *pattern, Config **cfg)
+{
+	DIR           *dir   = NULL;
+	struct dirent *ent   = NULL;
+	struct stat    st;
+	DirFragment   *frags = NULL;
+	DirFragment   *t;
+	int            numoffrags = 0;
+	int            size  = 0;
+	int            i;
+	Config        *_cfg  = NULL;
+	ConfigRet      ret   = CONFIG_OK;
+
+	if ( !path || !cfg || (*cfg && ((*cfg)->initnum != CONFIG_INIT_MAGIC)) )
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((dir = opendir(path)) == NULL)
+		return CONFIG_ERR_FILE;
+
+	while ((ent = readdir(dir)) != NULL) {
+		if ( (ent->d_name[0] == '.') ||
+			 (pattern && fnmatch(pattern, ent->d_name, 0)) )
+			continue;
+
+		if (numoffrags == size) {
+			size = size ? size * 2 : 16;
+			if ((t = realloc(frags, size * sizeof(DirFragment))) == NULL) {
+				ret = CONFIG_ERR_MEMALLOC;
+				goto out;
+			}
+			frags = t;
+		}
+
+		memset(&frags[numoffrags], 0, sizeof(DirFragment));
+		if ((frags[numoffrags].path = malloc(strlen(path) + strlen(ent->d_name) + 2)) == NULL) {
+			ret = CONFIG_ERR_MEMALLOC;
+			goto out;
+		}
+		sprintf(frags[numoffrags].path, "%s/%s", path, ent->d_name);
+
+		if ((stat(frags[numoffrags].path, &st) != 0) || !S_ISREG(st.st_mode)) {
+			free(frags[numoffrags].path);
+			continue;
+		}
+		++numoffrags;
+	}
+
+	qsort(frags, numoffrags, sizeof(DirFragment), CompareFragments);
+
+	/* fragments are parsed with the settings of the given handle */
+	for (i = 0; i < numoffrags; ++i) {
+		if ((frags[i].cfg = ConfigNew()) == NULL) {
+			ret = CONFIG_ERR_MEMALLOC;
+			goto out;
+		}
+		if (*cfg && ((ret = ConfigCopySettings(frags[i].cfg, *cfg)) != CONFIG_OK))
+			goto out;
+	}
+
+	RunParallel(numoffrags, 0, ReadFragment, frags);
+
+	for (i = 0; i < numoffrags; ++i) {
+		if ((ret = frags[i].ret) != CONFIG_OK) {
+			if (*cfg && frags[i].cfg->schema_err)
+				SchemaError(*cfg, "%s: %s", frags[i].path, frags[i].cfg->schema_err);
+			goto out;
+		}
+	}
+
+	if ((_cfg = *cfg) == NULL) {
+		if ((_cfg = ConfigNew()) == NULL) {
+			ret = CONFIG_ERR_MEMALLOC;
+			goto out;
+		}
+	}
+
+	/* a merge fails only before it moves anything, which can happen for the first fragment */
+	++_cfg->txn;
+	for (i = 0; (i < numoffrags) && (ret == CONFIG_OK); ++i) {
+		if ((ret = ConfigMerge(_cfg, frags[i].cfg, CONFIG_MERGE_OVERWRITE)) == CONFIG_OK)
+			StatsAbsorb(_cfg, frags[i].cfg);
+	}
+	--_cfg->txn;
+	SubFlush(_cfg);
+
+	/* required keys may be spread over fragments, so they are checked on the merged config */
+	if ((ret == CONFIG_OK) && _cfg->schema && !_cfg->nested)
+		ret = SchemaCheckRequired(_cfg);
+
+	if (ret != CONFIG_OK) {
+		if (_cfg != *cfg)
+			ConfigFree(_cfg);
+		goto out;
+	}
+
+	*cfg = _cfg;
+
+out:
+	for (i = 0; i < numoffrags; ++i) {
+		ConfigFree(frags[i].cfg);
+		free(frags[i].path);
+	}
+	free(frags);
+	closedir(dir);
+
+	return ret;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Asynchronous loading. On Linux files are opened, sized and read with io_uring and parsed
+ * by the thread calling ConfigAsyncPoll(); included files are read there with blocking
+ * calls. Elsewhere, or if io_uring is not available,
+ * worker threads read and parse the files and ConfigAsyncPoll() only dispatches
+ * the completions. In both cases callbacks run on the thread calling ConfigAsyncPoll().
+ */
+
+typedef struct ConfigAsyncReq
+{
+	char                *filename;
+	ConfigAsyncCallback  callback;
+	void                *arg;
+	Config              *cfg;
+	ConfigRet            ret;
+	int                  fd;
+	char                *data;          /* file content read so far */
+	size_t               size;          /* file size */
+	size_t               done;          /* bytes read */
+#ifdef HAVE_IO_URING
+	int                  stage;         /* ASYNC_OPEN, ASYNC_STATX or ASYNC_READ */
+	struct statx         stx;
+#endif
+	STAILQ_ENTRY(ConfigAsyncReq) next;
+} ConfigAsyncReq;
+
+STAILQ_HEAD(ConfigAsyncQueue, ConfigAsyncReq);
+
+#ifdef HAVE_IO_URING
+typedef struct AsyncRing
+{
+	int                  fd;
+	unsigned int        *sq_tail, *sq_mask, *sq_array;
+	unsigned int        *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void                *sq_ptr, *cq_ptr;
+	size_t               sq_size, cq_size, sqes_size;
+	unsigned int         entries;
+	unsigned int         inflight;      /* operations submitted and not completed */
+	unsigned int         tosubmit;      /* operations queued in sq and not yet taken by kernel */
+} AsyncRing;
+
+/* ring operation a request waits for */
+enum { ASYNC_OPEN, ASYNC_STATX, ASYNC_READ };
+#endif
+
+struct ConfigAsync
+{
+	pthread_mutex_t          lock;
+	pthread_cond_t           cond;      /* signalled on new requests and on completions */
+	struct ConfigAsyncQueue  todo;      /* requests waiting for a worker (or a ring slot) */
+	struct ConfigAsyncQueue  done;      /* requests waiting for ConfigAsyncPoll() */
+	int                      pending;   /* requests not dispatched yet */
+	unsigned int             completed; /* requests moved to done so far */
+	bool                     stop;
+	int                      numofthreads;
+	pthread_t                tids[MAX_THREADS];
+#ifdef HAVE_IO_URING
+	bool                     use_ring;
+	AsyncRing                ring;
+#endif
+};
+
+static void AsyncReqFree(ConfigAsyncReq *req)
+{
+	if (req->fd >= 0)
+		close(req->fd);
+	ConfigFree(req->cfg);
+	free(req->data);
+	free(req->filename);
+	free(req);
+}
+
+static void AsyncComplete(ConfigAsync *async, ConfigAsyncReq *req)
+{
+	pthread_mutex_lock(&async->lock);
+	STAILQ_INSERT_TAIL(&async->done, req, next);
+	++(async->completed);
+	pthread_cond_broadcast(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+}
+
+static void *AsyncWorker(void *arg)
+{
+	ConfigAsync    *async = arg;
+	ConfigAsyncReq *req;
+
+	pthread_mutex_lock(&async->lock);
+	for (;;) {
+		while (!async->stop && STAILQ_EMPTY(&async->todo))
+			pthread_cond_wait(&async->cond, &async->lock);
+		if (async->stop)
+			break;
+
+		req = STAILQ_FIRST(&async->todo);
+		STAILQ_REMOVE_HEAD(&async->todo, next);
+		pthread_mutex_unlock(&async->lock);
+
+		req->ret = ConfigReadFile(req->filename, &req->cfg);
+
+		pthread_mutex_lock(&async->lock);
+		STAILQ_INSERT_TAIL(&async->done, req, next);
+		pthread_cond_broadcast(&async->cond);
+	}
+	pthread_mutex_unlock(&async->lock);
+
+	return NULL;
+}
+
+#ifdef HAVE_IO_URING
+
+static bool AsyncRingInit(AsyncRing *r)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	if ((r->fd = (int) syscall(__NR_io_uring_setup, ASYNC_RING_ENTRIES, &p)) < 0)
+		return false;
+
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && (r->cq_size > r->sq_size))
+		r->sq_size = r->cq_size;
+
+	r->sq_ptr = r->cq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		goto error;
+
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED)
+			goto error_sq;
+	}
+
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto error_cq;
+
+	r->sq_tail  = (unsigned int *) ((char *) r->sq_ptr + p.sq_off.tail);
+	r->sq_mask  = (unsigned int *) ((char *) r->sq_ptr + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int *) ((char *) r->sq_ptr + p.sq_off.array);
+	r->cq_head  = (unsigned int *) ((char *) r->cq_ptr + p.cq_off.head);
+	r->cq_tail  = (unsigned int *) ((char *) r->cq_ptr + p.cq_off.tail);
+	r->cq_mask  = (unsigned int *) ((char *) r->cq_ptr + p.cq_off.ring_mask);
+	r->cqes     = (struct io_uring_cqe *) ((char *) r->cq_ptr + p.cq_off.cqes);
+	r->entries  = p.sq_entries;
+
+	return true;
+
+error_cq:
+	if (r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+error_sq:
+	munmap(r->sq_ptr, r->sq_size);
+error:
+	close(r->fd);
+	return false;
+}
+
+static void AsyncRingFree(AsyncRing *r)
+{
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+	munmap(r->sq_ptr, r->sq_size);
+	close(r->fd);
+}
+
+static void AsyncRingEnter(AsyncRing *r, bool wait)
+{
+	int n;
+
+	n = (int) syscall(__NR_io_uring_enter, r->fd, r->tosubmit, wait ? 1 : 0,
+			wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (n > 0)
+		r->tosubmit -= n;
+}
+
+/*
+ * queues the next operation of the request: opening the file, getting its size or reading
+ * the rest of it. Returns false if ring is full
+ */
+static bool AsyncRingQueue(AsyncRing *r, ConfigAsyncReq *req)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int         tail, idx;
+	size_t               len = req->size - req->done;
+
+	if (r->inflight >= r->entries)
+		return false;
+
+	tail = *r->sq_tail;
+	idx = tail & *r->sq_mask;
+	sqe = &r->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	switch (req->stage) {
+	case ASYNC_OPEN:
+		sqe->opcode     = IORING_OP_OPENAT;
+		sqe->fd         = AT_FDCWD;
+		sqe->addr       = (unsigned long) req->filename;
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		break;
+
+	case ASYNC_STATX:
+		sqe->opcode      = IORING_OP_STATX;
+		sqe->fd          = req->fd;
+		sqe->addr        = (unsigned long) "";
+		sqe->len         = STATX_SIZE;
+		sqe->off         = (unsigned long) &req->stx;
+		sqe->statx_flags = AT_EMPTY_PATH;
+		break;
+
+	default:
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd     = req->fd;
+		sqe->addr   = (unsigned long) (req->data + req->done);
+		sqe->len    = (len > ASYNC_READ_MAX) ? ASYNC_READ_MAX : (unsigned int) len;
+		sqe->off    = req->done;
+		break;
+	}
+	sqe->user_data = (unsigned long) req;
+
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	++(r->inflight);
+	++(r->tosubmit);
+
+	return true;
+}
+
+static void AsyncRingReadDone(ConfigAsync *async, ConfigAsyncReq *req, int res);
+
+/* allocates the buffer of a file whose size is known and queues its read */
+static void AsyncRingSized(ConfigAsync *async, ConfigAsyncReq *req, size_t size)
+{
+	req->size = size;
+	if ((req->data = malloc(req->size + 1)) == NULL) {
+		req->ret = CONFIG_ERR_MEMALLOC;
+		AsyncComplete(async, req);
+		return;
+	}
+
+	if (req->size == 0) {
+		AsyncRingReadDone(async, req, 0);
+		return;
+	}
+
+	req->stage = ASYNC_READ;
+	STAILQ_INSERT_TAIL(&async->todo, req, next);
+}
+
+/* opcodes added after IORING_OP_READ are done with blocking calls on kernels without them */
+static void AsyncRingOpenDone(ConfigAsync *async, ConfigAsyncReq *req, int res)
+{
+	struct stat st;
+
+	if ((res == -EINVAL) || (res == -EOPNOTSUPP)) {
+		if ( ((req->fd = open(req->filename, O_RDONLY | O_CLOEXEC)) < 0) ||
+			 (fstat(req->fd, &st) != 0) ) {
+			req->ret = CONFIG_ERR_FILE;
+			AsyncComplete(async, req);
+			return;
+		}
+		AsyncRingSized(async, req, st.st_size);
+	}
+	else if (res < 0) {
+		req->ret = CONFIG_ERR_FILE;
+		AsyncComplete(async, req);
+	}
+	else {
+		req->fd = res;
+		req->stage = ASYNC_STATX;
+		STAILQ_INSERT_TAIL(&async->todo, req, next);
+	}
+}
+
+static void AsyncRingStatxDone(ConfigAsync *async, ConfigAsyncReq *req, int res)
+{
+	struct stat st;
+
+	if ((res == -EINVAL) || (res == -EOPNOTSUPP)) {
+		if (fstat(req->fd, &st) != 0) {
+			req->ret = CONFIG_ERR_FILE;
+			AsyncComplete(async, req);
+			return;
+		}
+		AsyncRingSized(async, req, st.st_size);
+	}
+	else if (res < 0) {
+		req->ret = CONFIG_ERR_FILE;
+		AsyncComplete(async, req);
+	}
+	else
+		AsyncRingSized(async, req, req->stx.stx_size);
+}
+
+/* parses the file read, or falls back to stdio if the kernel cannot do the read */
+static void AsyncRingReadDone(ConfigAsync *async, ConfigAsyncReq *req, int res)
+{
+	if ((res > 0) && (req->done + res < req->size)) {
+		req->done += res;
+		STAILQ_INSERT_TAIL(&async->todo, req, next);
+		return;
+	}
+
+	if (res > 0)
+		req->done += res;
+
+	if ((res == -EINVAL) || (res == -EOPNOTSUPP))
+		req->ret = ConfigReadFile(req->filename, &req->cfg);
+	else if (res < 0)
+		req->ret = CONFIG_ERR_FILE;
+	else {
+		/* fmemopen() needs a non-empty buffer */
+		req->data[req->done] = '\0';
+		req->ret = ConfigReadFileChained(req->filename, req->data, req->done ? req->done : 1,
+				&req->cfg, NULL);
+	}
+
+	close(req->fd);
+	req->fd = -1;
+	free(req->data);
+	req->data = NULL;
+
+	AsyncComplete(async, req);
+}
+
+static void AsyncRingProcess(ConfigAsync *async, bool wait)
+{
+	AsyncRing           *r = &async->ring;
+	struct io_uring_cqe *cqe;
+	ConfigAsyncReq      *req;
+	unsigned int         head;
+	unsigned int         completed = async->completed;
+	int                  res;
+	bool                 block;
+
+	/* with wait, blocks until a request completes, not only one of its operations */
+	for (;;) {
+		while (!STAILQ_EMPTY(&async->todo) && AsyncRingQueue(r, STAILQ_FIRST(&async->todo)))
+			STAILQ_REMOVE_HEAD(&async->todo, next);
+
+		block = wait && (async->completed == completed) && r->inflight;
+		if (r->tosubmit || block)
+			AsyncRingEnter(r, block);
+
+		head = *r->cq_head;
+		while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &r->cqes[head & *r->cq_mask];
+			req = (ConfigAsyncReq *) (unsigned long) cqe->user_data;
+			res = cqe->res;
+			__atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+			--(r->inflight);
+
+			if (req->stage == ASYNC_OPEN)
+				AsyncRingOpenDone(async, req, res);
+			else if (req->stage == ASYNC_STATX)
+				AsyncRingStatxDone(async, req, res);
+			else
+				AsyncRingReadDone(async, req, res);
+		}
+
+		if ( !wait || (async->completed != completed) ||
+			 (!r->inflight && STAILQ_EMPTY(&async->todo)) )
+			break;
+	}
+
+	/* next operations of the requests completed, and reads of the rest of large files */
+	while (!STAILQ_EMPTY(&async->todo) && AsyncRingQueue(r, STAILQ_FIRST(&async->todo)))
+		STAILQ_REMOVE_HEAD(&async->todo, next);
+	if (r->tosubmit)
+		AsyncRingEnter(r, false);
+}
+
+/*
+ * queues the open of the file and submits it without reaping completions, which are only
+ * handled by ConfigAsyncPoll(). If ring is full the request waits there for a free entry
+ */
+static void AsyncRingSubmit(ConfigAsync *async, ConfigAsyncReq *req)
+{
+	AsyncRing *r = &async->ring;
+
+	req->stage = ASYNC_OPEN;
+	if (!STAILQ_EMPTY(&async->todo) || !AsyncRingQueue(r, req))
+		STAILQ_INSERT_TAIL(&async->todo, req, next);
+
+	if (r->tosubmit)
+		AsyncRingEnter(r, false);
+}
+
+#endif /* HAVE_IO_URING */
+
+/**
+ * \brief              ConfigAsyncNew() creates a handle for asynchronous loading.
+ *                     A handle must be driven (ConfigReadFileAsync(), ConfigAsyncPoll())
+ *                     by one thread at a time.
+ *
+ * \param nthreads     number of worker threads used when io_uring is not available,
+ *                     0 for number of online CPUs
+ *
+ * \return             ConfigAsync* handle on success, NULL on failure
+ */
+ConfigAsync *ConfigAsyncNew(int nthreads)
+{
+	ConfigAsync *async;
+	int          i;
+
+	if ((async = calloc(1, sizeof(ConfigAsync))) == NULL)
+		return NULL;
+
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_cond_init(&async->cond, NULL);
+	STAILQ_INIT(&async->todo);
+	STAILQ_INIT(&async->done);
+
+#ifdef HAVE_IO_URING
+	if ((async->use_ring = AsyncRingInit(&async->ring)))
+		return async;
+#endif
+
+	if (nthreads <= 0)
+		nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	for (i = 0; i < nthreads; ++i) {
+		if (pthread_create(&async->tids[async->numofthreads], NULL, AsyncWorker, async) == 0)
+			++(async->numofthreads);
+	}
+
+	return async;
+}
+
+/**
+ * \brief              ConfigAsyncFree() frees the handle. Requests which are not dispatched
+ *                     yet are cancelled (after their pending reads finish) and their
+ *                     callbacks are not called.
+ *
+ * \param async        async handle
+ */
+void ConfigAsyncFree(ConfigAsync *async)
+{
+	ConfigAsyncReq *req, *t_req;
+	int             i;
+
+	if (async == NULL)
+		return;
+
+	pthread_mutex_lock(&async->lock);
+	async->stop = true;
+	pthread_cond_broadcast(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+
+	for (i = 0; i < async->numofthreads; ++i)
+		pthread_join(async->tids[i], NULL);
+
+#ifdef HAVE_IO_URING
+	if (async->use_ring) {
+		/* kernel may still write into buffers of inflight reads */
+		while (async->ring.inflight)
+			AsyncRingProcess(async, true);
+		AsyncRingFree(&async->ring);
+	}
+#endif
+
+	STAILQ_FOREACH_SAFE(req, &async->todo, next, t_req)
+		AsyncReqFree(req);
+	STAILQ_FOREACH_SAFE(req, &async->done, next, t_req)
+		AsyncReqFree(req);
+
+	pthread_cond_destroy(&async->cond);
+	pthread_mutex_destroy(&async->lock);
+	free(async);
+}
+
+/**
+ * \brief              ConfigReadFileAsync() starts loading the file. Its callback is called
+ *                     from ConfigAsyncPoll() when the file is read and parsed.
+ *                     With io_uring the file is opened, sized and read by the kernel without
+ *                     blocking the caller, then parsed by the thread calling
+ *                     ConfigAsyncPoll(), which also reads included files with blocking
+ *                     calls. Without io_uring worker threads do all of it.
+ *
+ * \param async        async handle
+ * \param filename     name of file to open and load
+ * \param callback     function called with the result. On success the callback takes
+ *                     the ownership of the given config handle, on failure it is NULL.
+ * \param arg          user data passed to callback
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigReadFileAsync(ConfigAsync *async, const char *filename,
+		ConfigAsyncCallback callback, void *arg)
+{
+	ConfigAsyncReq *req;
+
+	if (!async || !filename || !callback)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	if ((req = calloc(1, sizeof(ConfigAsyncReq))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	if ((req->filename = strdup(filename)) == NULL) {
+		free(req);
+		return CONFIG_ERR_MEMALLOC;
+	}
+
+	req->callback = callback;
+	req->arg = arg;
+	req->fd = -1;
+
+	pthread_mutex_lock(&async->lock);
+	++(async->pending);
+	pthread_mutex_unlock(&async->lock);
+
+#ifdef HAVE_IO_URING
+	if (async->use_ring) {
+		AsyncRingSubmit(async, req);
+		return CONFIG_OK;
+	}
+#endif
+
+	/* no worker could be started, load it now */
+	if (async->numofthreads == 0) {
+		req->ret = ConfigReadFile(req->filename, &req->cfg);
+		AsyncComplete(async, req);
+		return CONFIG_OK;
+	}
+
+	pthread_mutex_lock(&async->lock);
+	STAILQ_INSERT_TAIL(&async->todo, req, next);
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigAsyncPoll() dispatches the callbacks of completed requests
+ *
+ * \param async        async handle
+ * \param wait         if true and nothing is completed yet, blocks until a request completes
+ *                     (returns immediately if there is no pending request)
+ *
+ * \return             Returns number of callbacks called, -1 on failure.
+ */
+int ConfigAsyncPoll(ConfigAsync *async, bool wait)
+{
+	struct ConfigAsyncQueue  done;
+	ConfigAsyncReq          *req, *t_req;
+	int                      n = 0;
+
+	if (async == NULL)
+		return -1;
+
+#ifdef HAVE_IO_URING
+	if (async->use_ring)
+		AsyncRingProcess(async, wait && STAILQ_EMPTY(&async->done));
+#endif
+
+	STAILQ_INIT(&done);
+
+	pthread_mutex_lock(&async->lock);
+	while (wait && STAILQ_EMPTY(&async->done) && (async->pending > 0) && async->numofthreads)
+		pthread_cond_wait(&async->cond, &async->lock);
+	STAILQ_CONCAT(&done, &async->done);
+	pthread_mutex_unlock(&async->lock);
+
+	STAILQ_FOREACH_SAFE(req, &done, next, t_req) {
+		req->callback(req->filename, req->ret, req->cfg, req->arg);
+		req->cfg = NULL;
+		AsyncReqFree(req);
+		++n;
+	}
+
+	pthread_mutex_lock(&async->lock);
+	async->pending -= n;
+	pthread_mutex_unlock(&async->lock);
+
+	return n;
+}
+
+/**
+ * \brief              ConfigAsyncPending() gets number of requests whose callbacks are
+ *                     not called yet
+ *
+ * \param async        async handle
+ *
+ * \return             Returns number of pending requests, -1 on failure.
+ */
+int ConfigAsyncPending(ConfigAsync *async)
+{
+	int n;
+
+	if (async == NULL)
+		return -1;
+
+	pthread_mutex_lock(&async->lock);
+	n = async->pending;
+	pthread_mutex_unlock(&async->lock);
+
+	return n;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Process-wide cache of read-only configs keyed by canonical path. An entry is
+ * reused as long as the file identity (device, inode, size, mtime) is unchanged.
+ * Entries are dropped from the cache when their last reference is released or
+ * when the file is found to be changed; handles still referenced stay valid.
+ */
+
+typedef struct SharedConfig
+{
+	char            *path;          /* canonical path */
+	dev_t            dev;
+	ino_t            ino;
+	off_t            size;
+	struct timespec  mtime;
+	Config          *cfg;
+	TAILQ_ENTRY(SharedConfig) next;
+} SharedConfig;
+
+static TAILQ_HEAD(, SharedConfig) shared_list = TAILQ_HEAD_INITIALIZER(shared_list);
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* must be called with shared_lock held */
+static void SharedRemove(SharedConfig *sc)
+{
+	TAILQ_REMOVE(&shared_list, sc, next);
+	sc->cfg->shared = NULL;
+	free(sc->path);
+	free(sc);
+}
+
+static bool SharedIsSameFile(const SharedConfig *sc, const struct stat *st)
+{
+	return ( (sc->dev == st->st_dev) && (sc->ino == st->st_ino) && (sc->size == st->st_size) &&
+			 (sc->mtime.tv_sec == st->st_mtim.tv_sec) && (sc->mtime.tv_nsec == st->st_mtim.tv_nsec) );
+}
+
+/* gets a reference to cached config of path or drops the entry if stale, must be called with shared_lock held */
+static Config *SharedLookup(const char *path, const struct stat *st)
+{
+	SharedConfig *sc;
+	int           n;
+
+	TAILQ_FOREACH(sc, &shared_list, next) {
+		if (strcmp(sc->path, path))
+			continue;
+
+		if (!SharedIsSameFile(sc, st))
+			break;
+
+		/* a config whose last reference is being released cannot be revived */
+		n = __atomic_load_n(&sc->cfg->refcnt, __ATOMIC_RELAXED);
+		while (n > 0) {
+			if (__atomic_compare_exchange_n(&sc->cfg->refcnt, &n, n + 1, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				return sc->cfg;
+		}
+
+		break;
+	}
+
+	if (sc)
+		SharedRemove(sc);
+
+	return NULL;
+}
+
+/**
+ * \brief              ConfigOpenShared() gets a read-only config handle of the file, which is
+ *                     shared with the other users of the same file in the process. The file
+ *                     is parsed only if it is not cached yet or it has changed since it
+ *                     was cached. The handle must be released with ConfigRelease(), never
+ *                     with ConfigFree(). Thread-safe.
+ *
+ * \param filename     name of file to open and load
+ * \param cfg          pointer to save the config handle
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigOpenShared(const char *filename, const Config **cfg)
+{
+	SharedConfig *sc;
+	Config       *_cfg = NULL;
+	Config       *c;
+	struct stat   st;
+	char          path[PATH_MAX];
+	ConfigRet     ret;
+
+	if (!filename || !cfg)
+		return CONFIG_ERR_INVALID_PARAM;
+
+	*cfg = NULL;
+
+	if ((realpath(filename, path) == NULL) || (stat(path, &st) != 0))
+		return CONFIG_ERR_FILE;
+
+	pthread_mutex_lock(&shared_lock);
+	c = SharedLookup(path, &st);
+	pthread_mutex_unlock(&shared_lock);
+
+	if (c) {
+		*cfg = c;
+		return CONFIG_OK;
+	}
+
+	/* parse without holding the lock */
+	if ((sc = calloc(1, sizeof(SharedConfig))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+	if ((sc->path = strdup(path)) == NULL) {
+		free(sc);
+		return CONFIG_ERR_MEMALLOC;
+	}
+	if ((ret = ConfigReadFile(path, &_cfg)) != CONFIG_OK) {
+		free(sc->path);
+		free(sc);
+		return ret;
+	}
+
+	sc->dev = st.st_dev;
+	sc->ino = st.st_ino;
+	sc->size = st.st_size;
+	sc->mtime = st.st_mtim;
+	sc->cfg = _cfg;
+
+	pthread_mutex_lock(&shared_lock);
+	/* someone else may have loaded it meanwhile */
+	if ((c = SharedLookup(path, &st)) == NULL) {
+		_cfg->shared = sc;
+		TAILQ_INSERT_HEAD(&shared_list, sc, next);
+		c = _cfg;
+		_cfg = NULL;
+		sc = NULL;
+	}
+	pthread_mutex_unlock(&shared_lock);
+
+	if (sc) {
+		free(sc->path);
+		free(sc);
+		ConfigFree(_cfg);
+	}
+
+	*cfg = c;
+
+	return CONFIG_OK;
+}
+
+/**
+ * \brief              ConfigRelease() drops a reference to the config handle and frees it
+ *                     when the last reference is dropped. Thread-safe.
+ *
+ * \param cfg          config handle from ConfigOpenShared(), or any handle owned by the caller
+ *                     (then it is the same as ConfigFree())
+ */
+void ConfigRelease(const Config *cfg)
+{
+	Config *_cfg = (Config *) cfg;
+
+	if (_cfg == NULL)
+		return;
+
+	if (__atomic_sub_fetch(&_cfg->refcnt, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	pthread_mutex_lock(&shared_lock);
+	if (_cfg->shared)
+		SharedRemove(_cfg->shared);
+	pthread_mutex_unlock(&shared_lock);
+
+	ConfigFree(_cfg);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Version history. Published configs are read-only and kept in a ring of the last
+ * depth versions, version v in slot v % depth, so rollback only moves the current
+ * version. Keys and values of all versions are interned in one table, so an unchanged
+ * value is stored once however many versions hold it.
+ */
+
+typedef struct StoreSlot
+{
+	Config             *cfg;            /* NULL if the slot is not used yet */
+	unsigned long long  version;
+	unsigned long long  time;           /* publish time (ns since epoch) */
+} StoreSlot;
+
+/**
+ * \brief Validator registered by ConfigStoreAddValidator()
+ */
+typedef struct StoreValidator
+{
+	char            *section;
+	bool             all;               /* runs for every section */
+	ConfigValidator  func;
+	void            *ctx;
+} StoreValidator;
+
+struct ConfigStore
+{
+	pthread_mutex_t     lock;
+	ConfigIntern       *intern;
+	StoreValidator     *validators;
+	int                 numofvalidators;
+	int                 depth;
+	StoreSlot          *slots;
+	unsigned long long  next;           /* version of the next published config */
+	unsigned long long  current;        /* version got by ConfigStoreGet() (0: none) */
+};
+
+/* moves heap strings of cfg to its intern table */
+static void InternAll(Config *cfg)
+{
+	ConfigSection  *sect;
+	ConfigKeyValue *kv;
+	unsigned int    h;
+	char           *p;
+
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		TAILQ_FOREACH(kv, &sect->kv_list, next) {
+			MemKeyVal(sect, kv, -1);
+
+			if (!(kv->interned & KV_KEY_INTERNED) && !ArenaOwns(kv->arena, kv->key)) {
+				if ((p = InternGet(cfg, kv->key, strlen(kv->key), &h)) != NULL) {
+					free(kv->key);
+					kv->key = p;
+					kv->interned |= KV_KEY_INTERNED;
+				}
+			}
+
+			if ( kv->value && !(kv->interned & KV_VALUE_INTERNED) &&
+				 !ArenaOwns(kv->arena, kv->value) ) {
+				if ((p = InternGet(cfg, kv->value, strlen(kv->value), &h)) != NULL) {
+					free(kv->value);
+					kv->value = p;
+					kv->interned |= KV_VALUE_INTERNED;
+				}
+			}
+
+			MemKeyVal(sect, kv, 1);
+		}
+	}
+}
+
+/**
+ * \brief              ConfigStoreNew() creates a version history of configs
+ *
+ * \param depth        number of versions kept, the oldest one is dropped when a new one
+ *                     is published to a full history
+ *
+ * \return             Returns the store on success, NULL on failure.
+ */
+ConfigStore *ConfigStoreNew(int depth)
+{
+	ConfigStore *store;
+
+	if (depth <= 0)
+		return NULL;
+
+	if ((store = calloc(1, sizeof(ConfigStore))) == NULL)
+		return NULL;
+
+	if ( ((store->slots = calloc(depth, sizeof(StoreSlot))) == NULL) ||
+		 ((store->intern = ConfigInternNew()) == NULL) ) {
+		free(store->slots);
+		free(store);
+		return NULL;
+	}
+
+	pthread_mutex_init(&store->lock, NULL);
+	store->depth = depth;
+	store->next  = 1;
+
+	return store;
+}
+
+/**
+ * \brief              ConfigStoreFree() frees the store and drops its references to the
+ *                     versions. Handles got by ConfigStoreGet() stay valid until released.
+ *
+ * \param store        config store
+ */
+void ConfigStoreFree(ConfigStore *store)
+{
+	int i;
+
+	if (store == NULL)
+		return;
+
+	for (i = 0; i < store->depth; ++i)
+		ConfigRelease(store->slots[i].cfg);
+
+	for (i = 0; i < store->numofvalidators; ++i)
+		free(store->validators[i].section);
+	free(store->validators);
+
+	ConfigInternFree(store->intern);
+	pthread_mutex_destroy(&store->lock);
+	free(store->slots);
+	free(store);
+}
+
+/**
+ * \brief              ConfigPublish() adds cfg to the store as its newest version and makes
+ *                     it the current one. The store takes over cfg, which must not be changed
+ *                     or freed by the caller afterwards. Its keys and values are interned in
+ *                     the table of the store unless it already uses an intern table.
+ *                     Thread-safe.
+ *
+ * \param store        config store
+ * \param cfg          config handle to publish
+ * \param version      pointer to save the version number or NULL if not needed
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigPublish(ConfigStore *store, Config *cfg, unsigned long long *version)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
+	struct timespec  ts;
+	StoreSlot       *slot;
+	Config          *old;
+	ConfigRet        ret;
 
-	if (!cfg || !key || !value || (size < 1))
+	if (!store || !cfg || cfg->shared)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	*value = '\0';
-
-	if ( ((ret = ConfigGetSection(cfg, section, &sect)) != CONFIG_OK) ||
-		 ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) != CONFIG_OK) ) {
-		if (dfl_value)
-			StrSafeCopy(value, dfl_value, size);
+	/* the config is not visible to readers yet */
+	if (!cfg->intern && ((ret = ConfigSetIntern(cfg, store->intern)) != CONFIG_OK))
 		return ret;
-	}
+	InternAll(cfg);
 
-	StrSafeCopy(value, kv->value, size);
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	pthread_mutex_lock(&store->lock);
+
+	slot = &store->slots[store->next % store->depth];
+	old  = slot->cfg;
+
+	slot->cfg     = cfg;
+	slot->version = store->next++;
+	slot->time    = (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	store->current = slot->version;
+
+	if (version)
+		*version = slot->version;
+
+	pthread_mutex_unlock(&store->lock);
+
+	ConfigRelease(old);
 
 	return CONFIG_OK;
 }
 
 /**
- * \brief              ConfigReadInt() reads an integer value from the cfg.
- *                     If any error occurs default value is copied to 'value' buffer and
- *                     returns reason. If key is optional and does not exists in config,
- *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ * \brief              ConfigStoreGet() gets a reference to the current version, which must be
+ *                     released with ConfigRelease(). Thread-safe.
  *
- * \param cfg          config handle
- * \param section      section to search in
- * \param key          key to search for
- * \param value        value to save in
- * \param dfl_value    default value to copy back if any error occurs
+ * \param store        config store
+ * \param cfg          pointer to save the config handle
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigReadInt(const Config *cfg, const char *section, const char *key,
-		int *value, int dfl_value)
+ConfigRet ConfigStoreGet(ConfigStore *store, const Config **cfg)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
-	char           *p    = NULL;
-
-	if (!cfg || !key || !value)
-		return  CONFIG_ERR_INVALID_PARAM;
+	Config *c = NULL;
 
-	*value = dfl_value;
+	if (!store || !cfg)
+		return CONFIG_ERR_INVALID_PARAM;
 
-	if ( ((ret = ConfigGetSection(cfg, section, &sect)) != CONFIG_OK) ||
-		 ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) != CONFIG_OK) ) {
-		return ret;
+	pthread_mutex_lock(&store->lock);
+	if (store->current) {
+		c = store->slots[store->current % store->depth].cfg;
+		__atomic_add_fetch(&c->refcnt, 1, __ATOMIC_RELAXED);
 	}
+	pthread_mutex_unlock(&store->lock);
 
-	*value = (int) strtol(kv->value, &p, 10);
-	if (*p || (errno == ERANGE))
-		return CONFIG_ERR_INVALID_VALUE;
+	*cfg = c;
 
-	return CONFIG_OK;
+	return c ? CONFIG_OK : CONFIG_ERR_INVALID_PARAM;
 }
 
 /**
- * \brief              ConfigReadUnsignedInt() reads an unsigned integer value from the cfg.
- *                     If any error occurs default value is copied to 'value' buffer and
- *                     returns reason. If key is optional and does not exists in config,
- *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ * \brief              ConfigRollback() makes a version kept in the store the current one.
+ *                     Nothing is read or copied, handles of other versions stay valid.
+ *                     Thread-safe.
  *
- * \param cfg          config handle
- * \param section      section to search in
- * \param key          key to search for
- * \param value        value to save in
- * \param dfl_value    default value to copy back if any error occurs
+ * \param store        config store
+ * \param version      version number returned by ConfigPublish() or ConfigHistory()
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \return             Returns CONFIG_RET_OK as success, CONFIG_ERR_INVALID_PARAM if the
+ *                     version is not in the store (anymore).
  */
-ConfigRet ConfigReadUnsignedInt(const Config *cfg, const char *section, const char *key,
-		unsigned int *value, unsigned int dfl_value)
+ConfigRet ConfigRollback(ConfigStore *store, unsigned long long version)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
-	char           *p    = NULL;
+	StoreSlot *slot;
+	ConfigRet  ret = CONFIG_ERR_INVALID_PARAM;
 
-	if (!cfg || !key || !value)
+	if (!store || !version)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	*value = dfl_value;
-
-	if ( ((ret = ConfigGetSection(cfg, section, &sect)) != CONFIG_OK) ||
-		 ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) != CONFIG_OK) ) {
-		return ret;
+	pthread_mutex_lock(&store->lock);
+	slot = &store->slots[version % store->depth];
+	if (slot->cfg && (slot->version == version)) {
+		store->current = version;
+		ret = CONFIG_OK;
 	}
+	pthread_mutex_unlock(&store->lock);
 
-	*value = (unsigned int) strtoul(kv->value, &p, 10);
-	if (*p || (errno == ERANGE))
-		return CONFIG_ERR_INVALID_VALUE;
-
-	return CONFIG_OK;
+	return ret;
 }
 
 /**
- * \brief              ConfigReadFloat() reads a float value from the cfg.
- *                     If any error occurs default value is copied to 'value' buffer and
- *                     returns reason. If key is optional and does not exists in config,
- *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ * \brief              ConfigHistory() lists the versions kept in the store, newest first.
+ *                     Thread-safe.
  *
- * \param cfg          config handle
- * \param section      section to search in
- * \param key          key to search for
- * \param value        value to save in
- * \param dfl_value    default value to copy back if any error occurs
+ * \param store        config store
+ * \param versions     array to save versions in
+ * \param n            size of the array
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \return             Returns number of versions saved on success, -1 on failure.
  */
-ConfigRet ConfigReadFloat(const Config *cfg, const char *section, const char *key,
-		float *value, float dfl_value)
+int ConfigHistory(ConfigStore *store, ConfigVersion *versions, int n)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
-	char           *p    = NULL;
-
-	if (!cfg || !key || !value)
-		return CONFIG_ERR_INVALID_PARAM;
+	unsigned long long  v;
+	StoreSlot          *slot;
+	int                 i = 0;
 
-	*value = dfl_value;
+	if (!store || !versions || (n < 0))
+		return -1;
 
-	if ( ((ret = ConfigGetSection(cfg, section, &sect)) != CONFIG_OK) ||
-		 ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) != CONFIG_OK) ) {
-		return ret;
+	pthread_mutex_lock(&store->lock);
+	for (v = store->next - 1; (v > 0) && (i < n); --v) {
+		slot = &store->slots[v % store->depth];
+		if (!slot->cfg || (slot->version != v))
+			break;
+		versions[i].version = v;
+		versions[i].time    = slot->time;
+		versions[i].current = (v == store->current);
+		++i;
 	}
+	pthread_mutex_unlock(&store->lock);
 
-	*value = strtof(kv->value, &p);
-	if (*p || (errno == ERANGE))
-		return CONFIG_ERR_INVALID_VALUE;
-
-	return CONFIG_OK;
+	return i;
 }
 
 /**
- * \brief              ConfigReadDouble() reads a double value from the cfg.
- *                     If any error occurs default value is copied to 'value' buffer and
- *                     returns reason. If key is optional and does not exists in config,
- *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ * \brief              ConfigStoreAddValidator() registers a check run by ConfigStoreReload()
+ *                     on the new config before it is published. Validators run concurrently,
+ *                     so they must only read the config and their own context.
  *
- * \param cfg          config handle
- * \param section      section to search in
- * \param key          key to search for
- * \param value        value to save in
- * \param dfl_value    default value to copy back if any error occurs
+ * \param store        config store
+ * \param section      section to validate, "*" to run the validator once for each section
+ *                     of the config. A validator of a named section also runs if the
+ *                     section is missing, so it can check required sections and keys.
+ * \param validator    function returning CONFIG_OK if the section is valid
+ * \param ctx          user data passed to validator
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigReadDouble(const Config *cfg, const char *section, const char *key,
-		double *value, double dfl_value)
+ConfigRet ConfigStoreAddValidator(ConfigStore *store, const char *section, ConfigValidator validator,
+		void *ctx)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
-	char           *p    = NULL;
+	StoreValidator *t;
+	StoreValidator  v = { NULL, false, validator, ctx };
 
-	if (!cfg || !key || !value)
+	if (!store || !validator)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	*value = dfl_value;
+	if (section && !strcmp(section, "*"))
+		v.all = true;
+	else if (section && ((v.section = strdup(section)) == NULL))
+		return CONFIG_ERR_MEMALLOC;
 
-	if ( ((ret = ConfigGetSection(cfg, section, &sect)) != CONFIG_OK) ||
-		 ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) != CONFIG_OK) ) {
-		return ret;
+	pthread_mutex_lock(&store->lock);
+	if ((t = realloc(store->validators, (store->numofvalidators + 1) * sizeof(StoreValidator))) != NULL) {
+		store->validators = t;
+		store->validators[store->numofvalidators++] = v;
 	}
+	pthread_mutex_unlock(&store->lock);
 
-	*value = strtod(kv->value, &p);
-	if (*p || (errno == ERANGE))
-		return CONFIG_ERR_INVALID_VALUE;
+	if (t == NULL) {
+		free(v.section);
+		return CONFIG_ERR_MEMALLOC;
+	}
 
 	return CONFIG_OK;
 }
 
+typedef struct ValidateJob
+{
+	const StoreValidator *validator;
+	const char           *section;
+	ConfigRet             ret;
+} ValidateJob;
+
+typedef struct ValidateBatch
+{
+	const Config *cfg;
+	ValidateJob  *jobs;
+} ValidateBatch;
+
+static void ValidateSection(void *arg, int idx)
+{
+	ValidateBatch *batch = arg;
+	ValidateJob   *job   = &batch->jobs[idx];
+
+	job->ret = job->validator->func(batch->cfg, job->section, job->validator->ctx);
+}
+
+/* runs validators of the store on cfg, one job per validator and section */
+static ConfigRet StoreValidate(ConfigStore *store, const Config *cfg, int nthreads)
+{
+	StoreValidator *validators = NULL;
+	ValidateBatch   batch      = { cfg, NULL };
+	ConfigSection  *sect;
+	ConfigRet       ret        = CONFIG_OK;
+	int             numofvalidators, numofjobs = 0, size = 0;
+	int             i;
+
+	/* validators added meanwhile are used by the next reload */
+	pthread_mutex_lock(&store->lock);
+	numofvalidators = store->numofvalidators;
+	if (numofvalidators && (validators = malloc(numofvalidators * sizeof(StoreValidator))) != NULL)
+		memcpy(validators, store->validators, numofvalidators * sizeof(StoreValidator));
+	pthread_mutex_unlock(&store->lock);
+
+	if (numofvalidators == 0)
+		return CONFIG_OK;
+	if (validators == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	for (i = 0; i < numofvalidators; ++i)
+		size += validators[i].all ? cfg->numofsect : 1;
+
+	if ((batch.jobs = malloc(size * sizeof(ValidateJob))) == NULL) {
+		free(validators);
+		return CONFIG_ERR_MEMALLOC;
+	}
+
+	for (i = 0; i < numofvalidators; ++i) {
+		if (!validators[i].all) {
+			batch.jobs[numofjobs].validator = &validators[i];
+			batch.jobs[numofjobs++].section = validators[i].section;
+			continue;
+		}
+		TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+			batch.jobs[numofjobs].validator = &validators[i];
+			batch.jobs[numofjobs++].section = sect->name;
+		}
+	}
+
+	RunParallel(numofjobs, nthreads, ValidateSection, &batch);
+
+	for (i = 0; (i < numofjobs) && (ret == CONFIG_OK); ++i)
+		ret = batch.jobs[i].ret;
+
+	free(batch.jobs);
+	free(validators);
+
+	return ret;
+}
+
 /**
- * \brief              ConfigReadBool() reads a boolean value from the cfg.
- *                     If any error occurs default value is copied to 'value' buffer and
- *                     returns reason. If key is optional and does not exists in config,
- *                     the 'value' is default value and return is CONFIG_ERR_NO_KEY
+ * \brief              ConfigStoreReload() reads the file into a new config, runs the validators
+ *                     of the store on it in parallel and publishes it only if all of them
+ *                     succeed. The current version keeps serving ConfigStoreGet() throughout
+ *                     and stays current if reading or validation fails. Thread-safe.
  *
- * \param cfg          config handle
- * \param section      section to search in
- * \param key          key to search for
- * \param value        value to save in
- * \param dfl_value    default value to copy back if any error occurs
+ * \param store        config store
+ * \param filename     name of file to open and load
+ * \param nthreads     number of threads running validators, 0 for number of online CPUs
+ * \param version      pointer to save the version number or NULL if not needed
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \return             Returns CONFIG_RET_OK as success, otherwise the error of reading or the
+ *                     error of the first failed validator.
  */
-ConfigRet ConfigReadBool(const Config *cfg, const char *section, const char *key,
-		bool *value, bool dfl_value)
+ConfigRet ConfigStoreReload(ConfigStore *store, const char *filename, int nthreads,
+		unsigned long long *version)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
+	Config    *cfg;
+	ConfigRet  ret;
 
-	if (!cfg || !key || !value)
+	if (!store || !filename)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	*value = dfl_value;
+	/* strings are interned while parsing, so publishing does not copy them again */
+	if ((cfg = ConfigNew()) == NULL)
+		return CONFIG_ERR_MEMALLOC;
 
-	if ( ((ret = ConfigGetSection(cfg, section, &sect)) != CONFIG_OK) ||
-		 ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) != CONFIG_OK) ) {
+	if ( ((ret = ConfigSetIntern(cfg, store->intern)) != CONFIG_OK) ||
+		 ((ret = ConfigReadFile(filename, &cfg)) != CONFIG_OK) ||
+		 ((ret = StoreValidate(store, cfg, nthreads)) != CONFIG_OK) ||
+		 ((ret = ConfigPublish(store, cfg, version)) != CONFIG_OK) ) {
+		ConfigFree(cfg);
 		return ret;
 	}
 
-	if (StrIsTypeOfTrue(kv->value))
-		*value = true;
-	else if (StrIsTypeOfFalse(kv->value))
-		*value = false;
-	else
-		return CONFIG_ERR_INVALID_VALUE;
-
 	return CONFIG_OK;
 }
 
@@ -575,204 +5699,281 @@ ConfigRet ConfigReadBool(const Config *cfg, const char *section, const char *key
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-/**
- * \brief              ConfigAddSection() creates a section in the cfg
- *
- * \param cfg          config handle
- * \param section      section to add
- * \param sect         pointer to added ConfigSection* or NULL if not needed
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-static ConfigRet ConfigAddSection(Config *cfg, const char *section, ConfigSection **sect)
+static void SchemaKeyFree(SchemaKey *sk)
 {
-	ConfigSection *_sect = NULL;
-	ConfigRet      ret   = CONFIG_OK;
-
-	if (!cfg)
-		return CONFIG_ERR_INVALID_PARAM;
-
-	if (!sect)
-		sect = &_sect;
+	int i;
+
+	for (i = 0; i < sk->numofvalues; ++i)
+		free(sk->values[i]);
+	free(sk->values);
+	if (sk->has_re)
+		regfree(&sk->re);
+	free(sk->key);
+	free(sk);
+}
 
-	if ((ret = ConfigGetSection(cfg, section, sect)) != CONFIG_ERR_NO_SECTION)
-		return ret;
+/* compiles rule into a check of a key */
+static ConfigRet SchemaKeyCompile(const ConfigSchemaKey *rule, SchemaKey **out)
+{
+	SchemaKey *sk;
+	char      *anchored;
+	int        i, n = 0;
+	int        err;
 
-	*sect = calloc(1, sizeof(ConfigSection));
-	if (*sect == NULL)
+	if ((sk = calloc(1, sizeof(SchemaKey))) == NULL)
 		return CONFIG_ERR_MEMALLOC;
 
-	if (section) {
-		if (((*sect)->name = strdup(section)) == NULL) {
-			free(*sect);
-			return CONFIG_ERR_MEMALLOC;
+	if ((sk->key = strdup(rule->key)) == NULL)
+		goto nomem;
+	sk->hash     = StrHash(rule->key);
+	sk->type     = rule->type;
+	sk->required = rule->required;
+	sk->ranged   = rule->ranged;
+	sk->min      = rule->min;
+	sk->max      = rule->max;
+
+	if (rule->values) {
+		while (rule->values[n])
+			++n;
+		if ((sk->values = calloc(n ? n : 1, sizeof(char *))) == NULL)
+			goto nomem;
+		for (i = 0; i < n; ++i, ++sk->numofvalues) {
+			if ((sk->values[i] = strdup(rule->values[i])) == NULL)
+				goto nomem;
 		}
+		qsort(sk->values, n, sizeof(char *), CompareStrings);
 	}
 
-	TAILQ_INIT(&(*sect)->kv_list);
-	TAILQ_INSERT_TAIL(&cfg->sect_list, *sect, next);
-	++(cfg->numofsect);
+	if (rule->pattern) {
+		/* the whole value must match */
+		if ((anchored = malloc(strlen(rule->pattern) + 5)) == NULL)
+			goto nomem;
+		sprintf(anchored, "^(%s)$", rule->pattern);
+		err = regcomp(&sk->re, anchored, REG_EXTENDED | REG_NOSUB);
+		free(anchored);
+		if (err != 0) {
+			SchemaKeyFree(sk);
+			return CONFIG_ERR_INVALID_PARAM;
+		}
+		sk->has_re = true;
+	}
+
+	*out = sk;
 
 	return CONFIG_OK;
+
+nomem:
+	SchemaKeyFree(sk);
+	return CONFIG_ERR_MEMALLOC;
 }
 
-/**
- * \brief              ConfigAddString() adds the key with string value to the cfg
- *
- * \param cfg          config handle
- * \param section      section to add in
- * \param key          key to save as
- * \param value        value to save as
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-ConfigRet ConfigAddString(Config *cfg, const char *section, const char *key, const char *value)
+static ConfigRet SchemaSectIndexRebuild(SchemaSection *ss, unsigned int size)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
-	const char     *p    = NULL;
-	const char     *q    = NULL;
+	SchemaKey    **htab, *sk;
 
-	if (!cfg || !key || !value)
-		return CONFIG_ERR_INVALID_PARAM;
+	if ((htab = calloc(size, sizeof(SchemaKey *))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
 
-	if ((ret = ConfigAddSection(cfg, section, &sect)) != CONFIG_OK)
-		return ret;
+	TAILQ_FOREACH(sk, &ss->key_list, next) {
+		sk->hnext = htab[sk->hash & (size - 1)];
+		htab[sk->hash & (size - 1)] = sk;
+	}
 
-	switch (ret = ConfigGetKeyValue(cfg, sect, key, &kv)) {
-		case CONFIG_OK:
-			if (kv->value) {
-				free(kv->value);
-				kv->value = NULL;
-			}
-			break;
+	free(ss->htab);
+	ss->htab = htab;
+	ss->htabsize = size;
 
-		case CONFIG_ERR_NO_KEY:
-			if ((kv = calloc(1, sizeof(ConfigKeyValue))) == NULL)
-				return CONFIG_ERR_MEMALLOC;
-			if ((kv->key = strdup(key)) == NULL) {
-				free(kv);
-				return CONFIG_ERR_MEMALLOC;
-			}
-			TAILQ_INSERT_TAIL(&sect->kv_list, kv, next);
-			++(sect->numofkv);
-			break;
+	return CONFIG_OK;
+}
 
-		default:
-			return ret;
+static ConfigRet SchemaIndexRebuild(ConfigSchema *schema, unsigned int size)
+{
+	SchemaSection **htab, *ss;
+
+	if ((htab = calloc(size, sizeof(SchemaSection *))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+
+	TAILQ_FOREACH(ss, &schema->sect_list, next) {
+		ss->hnext = htab[ss->hash & (size - 1)];
+		htab[ss->hash & (size - 1)] = ss;
 	}
 
-	for (p = value; *p && isspace(*p); ++p)
-		;
-	for (q = p; *q && (*q != '\r') && (*q != '\n') && !strchr(cfg->comment_chars, *q); ++q)
-		;
-	while (*q && (q > p) && isspace(*(q - 1)))
-		--q;
+	free(schema->htab);
+	schema->htab = htab;
+	schema->htabsize = size;
+
+	return CONFIG_OK;
+}
+
+/* gets the check table of section, which is created if not present yet */
+static ConfigRet SchemaAddSection(ConfigSchema *schema, const char *section, SchemaSection **out)
+{
+	SchemaSection *ss;
+	unsigned int   h = StrHash(section);
+	ConfigRet      ret;
+
+	if ((*out = SchemaFindSection(schema, section, h)) != NULL)
+		return CONFIG_OK;
 
-	kv->value = (char *) malloc(q - p + 1);
-	if (kv->value == NULL) {
-		TAILQ_REMOVE(&sect->kv_list, kv, next);
-		--(sect->numofkv);
-		free(kv->key);
-		free(kv);
+	if ( (schema->numofsects >= (int) schema->htabsize) &&
+		 ((ret = SchemaIndexRebuild(schema, schema->htabsize * 2)) != CONFIG_OK) )
+		return ret;
+
+	if ((ss = calloc(1, sizeof(SchemaSection))) == NULL)
+		return CONFIG_ERR_MEMALLOC;
+	if ( (section && ((ss->name = strdup(section)) == NULL)) ||
+		 ((ss->htab = calloc(HTAB_INIT_SIZE, sizeof(SchemaKey *))) == NULL) ) {
+		free(ss->name);
+		free(ss);
 		return CONFIG_ERR_MEMALLOC;
 	}
-	memcpy(kv->value, p, q - p);
-	kv->value[q - p] = '\0';
+	ss->hash = h;
+	ss->htabsize = HTAB_INIT_SIZE;
+	TAILQ_INIT(&ss->key_list);
+
+	TAILQ_INSERT_TAIL(&schema->sect_list, ss, next);
+	++schema->numofsects;
+	ss->hnext = schema->htab[h & (schema->htabsize - 1)];
+	schema->htab[h & (schema->htabsize - 1)] = ss;
+
+	*out = ss;
 
 	return CONFIG_OK;
 }
 
 /**
- * \brief              ConfigAddInt() adds the key with integer value to the cfg
- *
- * \param cfg          config handle
- * \param section      section to add in
- * \param key          key to save as
- * \param value        value to save as
+ * \brief              ConfigSchemaNew() creates an empty validation schema
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \return             Returns the schema on success, NULL on failure.
  */
-ConfigRet ConfigAddInt(Config *cfg, const char *section, const char *key, int value)
+ConfigSchema *ConfigSchemaNew(void)
 {
-	char buf[64];
+	ConfigSchema *schema;
 
-	snprintf(buf, sizeof(buf), "%d", value);
+	if ((schema = calloc(1, sizeof(ConfigSchema))) == NULL)
+		return NULL;
 
-	return ConfigAddString(cfg, section, key, buf);
+	if ((schema->htab = calloc(HTAB_INIT_SIZE, sizeof(SchemaSection *))) == NULL) {
+		free(schema);
+		return NULL;
+	}
+
+	schema->htabsize = HTAB_INIT_SIZE;
+	TAILQ_INIT(&schema->sect_list);
+
+	return schema;
 }
 
 /**
- * \brief              ConfigAddUnsignedInt() adds the key with unsigned integer value to the cfg
- *
- * \param cfg          config handle
- * \param section      section to add in
- * \param key          key to save as
- * \param value        value to save as
+ * \brief              ConfigSchemaFree() frees the schema, configs using it must have been
+ *                     freed or detached with ConfigSetSchema()
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \param schema       validation schema
  */
-ConfigRet ConfigAddUnsignedInt(Config *cfg, const char *section, const char *key, unsigned int value)
+void ConfigSchemaFree(ConfigSchema *schema)
 {
-	char buf[64];
+	SchemaSection *ss, *t_ss;
+	SchemaKey     *sk, *t_sk;
 
-	snprintf(buf, sizeof(buf), "%u", value);
+	if (schema == NULL)
+		return;
 
-	return ConfigAddString(cfg, section, key, buf);
+	TAILQ_FOREACH_SAFE(ss, &schema->sect_list, next, t_ss) {
+		TAILQ_FOREACH_SAFE(sk, &ss->key_list, next, t_sk) {
+			SchemaKeyFree(sk);
+		}
+		free(ss->htab);
+		free(ss->name);
+		free(ss);
+	}
+
+	free(schema->htab);
+	free(schema);
 }
 
 /**
- * \brief              ConfigAddFloat() adds the key with float value to the cfg
+ * \brief              ConfigSchemaAddKey() compiles the rule of a key into the check table of
+ *                     its section. A later rule of the same key replaces the earlier one.
+ *                     The strings of rule are copied.
  *
- * \param cfg          config handle
- * \param section      section to add in
- * \param key          key to save as
- * \param value        value to save as
+ * \param schema       validation schema
+ * \param rule         rule to add
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \return             Returns CONFIG_RET_OK as success, CONFIG_ERR_INVALID_PARAM if the
+ *                     pattern cannot be compiled, otherwise is an error.
  */
-ConfigRet ConfigAddFloat(Config * cfg, const char *section, const char *key, float value)
+ConfigRet ConfigSchemaAddKey(ConfigSchema *schema, const ConfigSchemaKey *rule)
 {
-	char buf[64];
+	SchemaSection *ss;
+	SchemaKey     *sk, *old, **pp;
+	ConfigRet      ret;
 
-	snprintf(buf, sizeof(buf), "%f", value);
+	if (!schema || !rule || !rule->key || (rule->ranged && (rule->min > rule->max)))
+		return CONFIG_ERR_INVALID_PARAM;
 
-	return ConfigAddString(cfg, section, key, buf);
+	if ((ret = SchemaAddSection(schema, rule->sect, &ss)) != CONFIG_OK)
+		return ret;
+
+	if ((ret = SchemaKeyCompile(rule, &sk)) != CONFIG_OK)
+		return ret;
+
+	if ((old = SchemaFindKey(ss, sk->key, sk->hash)) != NULL) {
+		pp = &ss->htab[old->hash & (ss->htabsize - 1)];
+		while (*pp != old)
+			pp = &(*pp)->hnext;
+		*pp = old->hnext;
+		TAILQ_REMOVE(&ss->key_list, old, next);
+		--ss->numofkeys;
+		SchemaKeyFree(old);
+	}
+
+	if ( (ss->numofkeys >= (int) ss->htabsize) &&
+		 ((ret = SchemaSectIndexRebuild(ss, ss->htabsize * 2)) != CONFIG_OK) ) {
+		SchemaKeyFree(sk);
+		return ret;
+	}
+
+	TAILQ_INSERT_TAIL(&ss->key_list, sk, next);
+	++ss->numofkeys;
+	sk->hnext = ss->htab[sk->hash & (ss->htabsize - 1)];
+	ss->htab[sk->hash & (ss->htabsize - 1)] = sk;
+
+	return CONFIG_OK;
 }
 
 /**
- * \brief              ConfigAddDouble() adds the key with double value to the cfg
+ * \brief              ConfigSetSchema() makes cfg check keys against the schema as they are
+ *                     added, including while a file is read, so an invalid value fails the
+ *                     read at its line. Required keys are checked when a read is done.
+ *                     The reason of a failure is got by ConfigGetSchemaError().
  *
  * \param cfg          config handle
- * \param section      section to add in
- * \param key          key to save as
- * \param value        value to save as
+ * \param schema       validation schema which must outlive cfg, NULL to stop checking
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigAddDouble(Config *cfg, const char *section, const char *key, double value)
+ConfigRet ConfigSetSchema(Config *cfg, const ConfigSchema *schema)
 {
-	char buf[64];
+	if (!cfg)
+		return CONFIG_ERR_INVALID_PARAM;
 
-	snprintf(buf, sizeof(buf), "%f", value);
+	cfg->schema = schema;
 
-	return ConfigAddString(cfg, section, key, buf);
+	return CONFIG_OK;
 }
 
 /**
- * \brief              ConfigAddBool() adds the key with blooean value to the cfg
+ * \brief              ConfigGetSchemaError() gets the reason of the last schema violation.
+ *                     Violations in included files and directory fragments are prefixed
+ *                     with the path of the file.
  *
  * \param cfg          config handle
- * \param section      section to add in
- * \param key          key to save as
- * \param value        value to save as
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \return             Returns the message, NULL if there is none.
  */
-ConfigRet ConfigAddBool(Config * cfg, const char *section, const char *key, bool value)
+const char *ConfigGetSchemaError(const Config *cfg)
 {
-	return ConfigAddString(cfg, section, key, value ? cfg->true_str : cfg->false_str);
+	return cfg ? cfg->schema_err : NULL;
 }
 
 
@@ -781,442 +5982,546 @@ ConfigRet ConfigAddBool(Config * cfg, const char *section, const char *key, bool
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-static void _ConfigRemoveKey(ConfigSection *sect, ConfigKeyValue *kv)
-{
-	TAILQ_REMOVE(&sect->kv_list, kv, next);
-	--(sect->numofkv);
-
-	if (kv->key)
-		free(kv->key);
-	if (kv->value)
-		free(kv->value);
-	free(kv);
-}
-
 /**
- * \brief              ConfigRemoveKey() removes the key which exists under section from the cfg
+ * \brief              ConfigPrint() prints all cfg content to the stream
  *
  * \param cfg          config handle
- * \param section      section to seach in
- * \param key          key to remove
+ * \param stream       stream to print
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigRemoveKey(Config *cfg, const char *section, const char *key)
+ConfigRet ConfigPrint(const Config *cfg, FILE *stream)
 {
 	ConfigSection  *sect = NULL;
 	ConfigKeyValue *kv   = NULL;
-	ConfigRet       ret  = CONFIG_OK;
 
-	if (!cfg || !key)
+	if (!cfg || !stream)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	if ((ret = ConfigGetSection(cfg, section, &sect)) == CONFIG_OK) {
-		if ((ret = ConfigGetKeyValue(cfg, sect, key, &kv)) == CONFIG_OK)
-			_ConfigRemoveKey(sect, kv);
-	}
-
-	return ret;
-}
-
-static void _ConfigRemoveSection(Config *cfg, ConfigSection *sect)
-{
-	ConfigKeyValue *kv, *t_kv;
-
-	if (!cfg || !sect)
-		return;
+	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
+		if (sect->name)
+			fprintf(stream, "[%s]\n", sect->name);
 
-	TAILQ_REMOVE(&cfg->sect_list, sect, next);
-	--(cfg->numofsect);
+		TAILQ_FOREACH(kv, &sect->kv_list, next)
+			fprintf(stream, "%s=%s\n", kv->key, kv->value);
 
-	TAILQ_FOREACH_SAFE(kv, &sect->kv_list, next, t_kv) {
-		_ConfigRemoveKey(sect, kv);
+		fprintf(stream, "\n");
 	}
 
-	if (sect->name)
-		free(sect->name);
-	free(sect);
+	return CONFIG_OK;
 }
 
 /**
- * \brief              ConfigRemoveSection() removes section from the cfgfile
+ * \brief              ConfigPrintToFile() prints (saves) all cfg content to the file
  *
  * \param cfg          config handle
- * \param section      section to remove
+ * \param filename     filename to save in
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigRemoveSection(Config *cfg, const char *section)
+ConfigRet ConfigPrintToFile(const Config *cfg, char *filename)
 {
-	ConfigSection *sect = NULL;
-	ConfigRet      ret  = CONFIG_OK;
+	FILE      *fp  = NULL;
+	ConfigRet  ret = CONFIG_OK;
 
-	if (!cfg)
+	if (!cfg || !filename)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	if ((ret = ConfigGetSection(cfg, section, &sect)) == CONFIG_OK)
-		_ConfigRemoveSection(cfg, sect);
-
-	return ret;
-}
-
-/**
- * \brief              ConfigNew() creates a cfg handle with
- *                     default section which has no section name
- *
- * \return             Config* handle on success, NULL on failure
- */
-Config *ConfigNew()
-{
-	Config *cfg = NULL;
-
-	cfg = calloc(1, sizeof(Config));
-	if (cfg == NULL)
-		return NULL;
-
-	TAILQ_INIT(&cfg->sect_list);
+	if ((fp = fopen(filename, "wb")) == NULL)
+		return CONFIG_ERR_FILE;
 
-	/* add default section */
-	if (ConfigAddSection(cfg, CONFIG_SECTION_FLAT, NULL) != CONFIG_OK) {
-		free(cfg);
-		return NULL;
-	}
+	ret = ConfigPrint(cfg, fp);
 
-	cfg->comment_chars = strdup(COMMENT_CHARS);
-	cfg->keyval_sep = KEYVAL_SEP;
-	cfg->true_str = strdup(STR_TRUE);
-	cfg->false_str = strdup(STR_FALSE);
-	cfg->initnum = CONFIG_INIT_MAGIC;
+	fclose(fp);
 
-	return cfg;
+	return ret;
 }
 
 /**
- * \brief          ConfigFree() frees the memory for the cfg handle
+ * \brief              ConfigPrintSettings() prints settings to the stream
  *
- * \param cfg      config handle
+ * \param cfg          config handle
+ * \param stream       stream to print
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-void ConfigFree(Config *cfg)
+ConfigRet ConfigPrintSettings(const Config *cfg, FILE *stream)
 {
-	ConfigSection *sect, *t_sect;
-
-	if (cfg == NULL)
-		return;
-
-	TAILQ_FOREACH_SAFE(sect, &cfg->sect_list, next, t_sect) {
-		_ConfigRemoveSection(cfg, sect);
-	}
+	if (!cfg || !stream)
+		return CONFIG_ERR_INVALID_PARAM;
 
-	if (cfg->comment_chars) free(cfg->comment_chars);
-	if (cfg->true_str)      free(cfg->true_str);
-	if (cfg->false_str)     free(cfg->false_str);
+	fprintf(stream, "\n");
+	fprintf(stream, "Configuration settings: \n");
+	fprintf(stream, "   Comment characters : %s\n", cfg->comment_chars);
+	fprintf(stream, "   Key-Value seperator: %c\n", cfg->keyval_sep);
+	fprintf(stream, "   True-False strings : %s-%s\n", cfg->true_str, cfg->false_str);
+	fprintf(stream, "\n");
 
-	free(cfg);
+	return CONFIG_OK;
 }
 
 
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 
 /**
- * \brief              Gets section name on the buffer p
- *
- * \param cfg          config handle
- * \param p            read buffer
- * \param section      pointer address to section
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \brief Streaming writer, renders sections and key-values straight into an output
+ *        buffer in ConfigPrint() format without building a config
  */
-static ConfigRet GetSectName(Config *cfg, char *p, char **section)
+struct ConfigWriter
 {
-	char *q, *r;
-
-	if (!cfg || !p || !*p || !section)
-		return CONFIG_ERR_INVALID_PARAM;
-
-	*section = NULL;
-
-	/* get section name */
-	while (*p && isspace(*p))
-		++p;
-
-	if (*p != '[')
-		return CONFIG_ERR_PARSING;
-
-	++p;
-	while (*p && isspace(*p))
-		++p;
+	int        fd;
+	size_t     len;                  /* bytes in buf */
+	ConfigRet  ret;                  /* first write error, reported by ConfigWriterClose() */
+	char       buf[WRITER_BUF_SIZE];
+};
 
-	for (q = p;
-		 *q && (*q != '\r') && (*q != '\n') && (*q != ']') && !strchr(cfg->comment_chars, *q);
-		 ++q)
-		;
+static void WriterFlush(ConfigWriter *w, const char *p, size_t len)
+{
+	ssize_t n;
 
-	if (*q != ']')
-		return CONFIG_ERR_PARSING;
+	while ((len > 0) && (w->ret == CONFIG_OK)) {
+		if ((n = write(w->fd, p, len)) < 0) {
+			if (errno != EINTR)
+				w->ret = CONFIG_ERR_FILE;
+			continue;
+		}
+		/* no progress, retrying would spin forever */
+		if (n == 0) {
+			w->ret = CONFIG_ERR_FILE;
+			break;
+		}
+		p += n;
+		len -= n;
+	}
+}
 
-	r = q + 1;
+static void WriterAppend(ConfigWriter *w, const char *s, size_t len)
+{
+	if (w->len + len > sizeof(w->buf)) {
+		WriterFlush(w, w->buf, w->len);
+		w->len = 0;
+
+		/* does not fit even to an empty buffer */
+		if (len > sizeof(w->buf)) {
+			WriterFlush(w, s, len);
+			return;
+		}
+	}
 
-	while (*q && (q > p) && isspace(*(q - 1)))
-		--q;
+	memcpy(w->buf + w->len, s, len);
+	w->len += len;
+}
 
-	if (q == p) /* section has no name */
-		return CONFIG_ERR_PARSING;
+/**
+ * \brief              ConfigWriterOpen() creates a streaming writer. Key-values written
+ *                     before the first section are written as flat data.
+ *
+ * \param fd           file descriptor to write to (not closed by the writer)
+ *
+ * \return             ConfigWriter* handle on success, NULL on failure
+ */
+ConfigWriter *ConfigWriterOpen(int fd)
+{
+	ConfigWriter *w;
 
-	*q = '\0';
-	*section = p;
+	if (fd < 0)
+		return NULL;
 
-	/* check rest of section */
-	while (*r && isspace(*r))
-		++r;
+	if ((w = malloc(sizeof(ConfigWriter))) == NULL)
+		return NULL;
 
-	/* there are unrecognized trailing data */
-	if (*r && !strchr(cfg->comment_chars, *r))
-		return CONFIG_ERR_PARSING;
+	w->fd = fd;
+	w->len = 0;
+	w->ret = CONFIG_OK;
 
-	return CONFIG_OK;
+	return w;
 }
 
 /**
- * \brief              Gets key and value on the buffer p
+ * \brief              ConfigWriterClose() flushes the buffered output and frees the writer
  *
- * \param cfg          config handle
- * \param p            read buffer
- * \param key          pointer address to key
- * \param val          pointer address to value
+ * \param w            writer handle
  *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ * \return             Returns CONFIG_RET_OK if all output is written, otherwise is an error.
  */
-static ConfigRet GetKeyVal(Config *cfg, char *p, char **key, char **val)
+ConfigRet ConfigWriterClose(ConfigWriter *w)
 {
-	char *q, *v;
+	ConfigRet ret;
 
-	if (!cfg || !p || !*p || !key || !val)
+	if (w == NULL)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	*key = *val = NULL;
-
-	/* get key */
-	while (*p && isspace(*p))
-		++p;
+	/* end of last section */
+	WriterAppend(w, "\n", 1);
+	WriterFlush(w, w->buf, w->len);
 
-	for (q = p;
-		 *q && (*q != '\r') && (*q != '\n') && (*q != cfg->keyval_sep) && !strchr(cfg->comment_chars, *q);
-		 ++q)
-		;
+	ret = w->ret;
+	free(w);
 
-	if (*q != cfg->keyval_sep)
-		return CONFIG_ERR_PARSING;
+	return ret;
+}
 
-	v = q + 1;
+/**
+ * \brief              ConfigWriterSection() starts a new section
+ *
+ * \param w            writer handle
+ * \param section      section name
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigWriterSection(ConfigWriter *w, const char *section)
+{
+	if (!w || !section || !*section)
+		return CONFIG_ERR_INVALID_PARAM;
 
-	while (*q && (q > p) && isspace(*(q - 1)))
-		--q;
+	/* end of previous section */
+	WriterAppend(w, "\n[", 2);
+	WriterAppend(w, section, strlen(section));
+	WriterAppend(w, "]\n", 2);
 
-	if (q == p) /* no key name */
-		return CONFIG_ERR_PARSING;
+	return w->ret;
+}
 
-	*q = '\0';
-	*key = p;
+/**
+ * \brief              ConfigWriterKey() writes the key with string value to current section
+ *
+ * \param w            writer handle
+ * \param key          key to write
+ * \param value        value to write
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigWriterKey(ConfigWriter *w, const char *key, const char *value)
+{
+	size_t klen, vlen, n;
 
-	/* get value */
-	while (*v && isspace(*v))
-		++v;
+	if (!w || !key || !value)
+		return CONFIG_ERR_INVALID_PARAM;
 
-	for (q = v;
-		 *q && (*q != '\r') && (*q != '\n') && !strchr(cfg->comment_chars, *q);
-		 ++q)
-		;
+	klen = strlen(key);
+	vlen = strlen(value);
+	n = klen + vlen + 2;
 
-	while (*q && (q > v) && isspace(*(q - 1)))
-		--q;
+	if (n > sizeof(w->buf)) {
+		WriterAppend(w, key, klen);
+		WriterAppend(w, "=", 1);
+		WriterAppend(w, value, vlen);
+		WriterAppend(w, "\n", 1);
+		return w->ret;
+	}
 
-	if (q == v) /* no value */
-		return CONFIG_ERR_INVALID_VALUE;
+	/* common case is formatted in place */
+	if (w->len + n > sizeof(w->buf)) {
+		WriterFlush(w, w->buf, w->len);
+		w->len = 0;
+	}
 
-	*q = '\0';
-	*val = v;
+	memcpy(w->buf + w->len, key, klen);
+	w->buf[w->len + klen] = '=';
+	memcpy(w->buf + w->len + klen + 1, value, vlen);
+	w->buf[w->len + n - 1] = '\n';
+	w->len += n;
 
-	return CONFIG_OK;
+	return w->ret;
 }
 
 /**
- * \brief              ConfigRead() reads the stream and populates the entire content to cfg handle
+ * \brief              ConfigWriterKeyInt() writes the key with integer value to current section
  *
- * \param fp           FILE handle to read
- * \param cfg          pointer to config handle.
- *                     If not NULL a handle created with ConfigNew() must be given.
- *                     If cfg is NULL a new one is created and saved to cfg.
+ * \param w            writer handle
+ * \param key          key to write
+ * \param value        value to write
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigRead(FILE *fp, Config **cfg)
+ConfigRet ConfigWriterKeyInt(ConfigWriter *w, const char *key, int value)
 {
-	ConfigSection *sect    = NULL;
-	char          *p       = NULL;
-	char          *section = NULL;
-	char          *key     = NULL;
-	char          *val     = NULL;
-	char           buf[4096];
-	Config        *_cfg    = NULL;
-	bool           newcfg  = false;
-	ConfigRet      ret     = CONFIG_OK;
+	char buf[64];
 
-	if ( !fp || !cfg || (*cfg && ((*cfg)->initnum != CONFIG_INIT_MAGIC)) )
-		return CONFIG_ERR_INVALID_PARAM;
+	snprintf(buf, sizeof(buf), "%d", value);
 
-	if (*cfg == NULL) {
-		_cfg = ConfigNew();
-		if (_cfg == NULL)
-			return CONFIG_ERR_MEMALLOC;
-		*cfg = _cfg;
-		newcfg = true;
-	}
-	else
-		_cfg = *cfg;
+	return ConfigWriterKey(w, key, buf);
+}
 
-	while (!feof(fp)) {
-		if (fgets(buf, sizeof(buf), fp) == NULL)
-			continue;
+/**
+ * \brief              ConfigWriterKeyUnsignedInt() writes the key with unsigned integer value
+ *                     to current section
+ *
+ * \param w            writer handle
+ * \param key          key to write
+ * \param value        value to write
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigWriterKeyUnsignedInt(ConfigWriter *w, const char *key, unsigned int value)
+{
+	char buf[64];
 
-		for (p = buf; *p && isspace(*p) ; ++p)
-			;
-		if (!*p || strchr(_cfg->comment_chars, *p))
-			continue;
+	snprintf(buf, sizeof(buf), "%u", value);
 
-		if (*p == '[') {
-			if ((ret = GetSectName(_cfg, p, &section)) != CONFIG_OK)
-				goto error;
+	return ConfigWriterKey(w, key, buf);
+}
 
-			if ((ret = ConfigAddSection(_cfg, section, &sect)) != CONFIG_OK)
-				goto error;
-		}
-		else {
-			if ((ret = GetKeyVal(_cfg, p, &key, &val)) != CONFIG_OK)
-				goto error;
+/**
+ * \brief              ConfigWriterKeyFloat() writes the key with float value to current section
+ *
+ * \param w            writer handle
+ * \param key          key to write
+ * \param value        value to write
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigWriterKeyFloat(ConfigWriter *w, const char *key, float value)
+{
+	char buf[64];
 
-			if ((ret = ConfigAddString(_cfg, sect->name, key, val)) != CONFIG_OK)
-				goto error;
-		}
-	}
+	snprintf(buf, sizeof(buf), "%f", value);
 
-	return CONFIG_OK;
+	return ConfigWriterKey(w, key, buf);
+}
 
-error:
-	if (newcfg) {
-		ConfigFree(_cfg);
-		*cfg = NULL;
-	}
+/**
+ * \brief              ConfigWriterKeyDouble() writes the key with double value to current section
+ *
+ * \param w            writer handle
+ * \param key          key to write
+ * \param value        value to write
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigWriterKeyDouble(ConfigWriter *w, const char *key, double value)
+{
+	char buf[64];
 
-	return ret;
+	snprintf(buf, sizeof(buf), "%f", value);
+
+	return ConfigWriterKey(w, key, buf);
 }
 
 /**
- * \brief              ConfigReadFile() opens and reads the file and populates the
- *                     entire content to cfg handle
+ * \brief              ConfigWriterKeyBool() writes the key with boolean value (as default
+ *                     true-false strings) to current section
  *
- * \param filename     name of file to open and load
- * \param cfg          pointer to config handle.
- *                     If not NULL a handle created with ConfigNew() must be given.
- *                     If cfg is NULL a new one is created and saved to cfg.
+ * \param w            writer handle
+ * \param key          key to write
+ * \param value        value to write
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigReadFile(const char *filename, Config **cfg)
+ConfigRet ConfigWriterKeyBool(ConfigWriter *w, const char *key, bool value)
 {
-	FILE      *fp  = NULL;
-	ConfigRet  ret = CONFIG_OK;
+	return ConfigWriterKey(w, key, value ? STR_TRUE : STR_FALSE);
+}
 
-	if ( !filename || !cfg || (*cfg && ((*cfg)->initnum != CONFIG_INIT_MAGIC)) )
+/**
+ * \brief              ConfigWriterInclude() writes an include directive to current section
+ *
+ * \param w            writer handle
+ * \param path         path of file to include
+ *
+ * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
+ */
+ConfigRet ConfigWriterInclude(ConfigWriter *w, const char *path)
+{
+	if (!w || !path || !*path)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	if ((fp = fopen(filename, "r")) == NULL)
-		return CONFIG_ERR_FILE;
+	WriterAppend(w, INCLUDE_DIRECTIVE " \"", sizeof(INCLUDE_DIRECTIVE) + 1);
+	WriterAppend(w, path, strlen(path));
+	WriterAppend(w, "\"\n", 2);
 
-	ret = ConfigRead(fp, cfg);
+	return w->ret;
+}
 
-	fclose(fp);
 
-	return ret;
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * \brief Streaming transform pipeline, ConfigParseStream() events pass through the
+ *        transforms in the order they are added and the result goes to a ConfigWriter
+ */
+struct ConfigPipeline
+{
+	ConfigTransform *transforms;
+	int              numoftransforms;
+
+	/* state of ConfigPipelineRun() */
+	ConfigWriter    *w;
+	char            *sect;           /* current (possibly renamed) section, NULL for flat */
+	size_t           sectsize;
+	bool             flat;
+	bool             dropped;        /* current section is dropped */
+};
+
+/**
+ * \brief              ConfigPipelineNew() creates an empty transform pipeline
+ *
+ * \return             ConfigPipeline* handle on success, NULL on failure
+ */
+ConfigPipeline *ConfigPipelineNew(void)
+{
+	return calloc(1, sizeof(ConfigPipeline));
 }
 
 /**
- * \brief              ConfigPrint() prints all cfg content to the stream
+ * \brief              ConfigPipelineFree() frees the pipeline
  *
- * \param cfg          config handle
- * \param stream       stream to print
+ * \param pl           pipeline handle
+ */
+void ConfigPipelineFree(ConfigPipeline *pl)
+{
+	if (pl == NULL)
+		return;
+
+	free(pl->transforms);
+	free(pl->sect);
+	free(pl);
+}
+
+/**
+ * \brief              ConfigPipelineAdd() appends a transform to the pipeline
+ *
+ * \param pl           pipeline handle
+ * \param t            transform to copy, any of its callbacks may be NULL
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigPrint(const Config *cfg, FILE *stream)
+ConfigRet ConfigPipelineAdd(ConfigPipeline *pl, const ConfigTransform *t)
 {
-	ConfigSection  *sect = NULL;
-	ConfigKeyValue *kv   = NULL;
+	ConfigTransform *p;
 
-	if (!cfg || !stream)
+	if (!pl || !t)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	TAILQ_FOREACH(sect, &cfg->sect_list, next) {
-		if (sect->name)
-			fprintf(stream, "[%s]\n", sect->name);
+	p = realloc(pl->transforms, (pl->numoftransforms + 1) * sizeof(ConfigTransform));
+	if (p == NULL)
+		return CONFIG_ERR_MEMALLOC;
 
-		TAILQ_FOREACH(kv, &sect->kv_list, next)
-			fprintf(stream, "%s=%s\n", kv->key, kv->value);
+	pl->transforms = p;
+	pl->transforms[pl->numoftransforms++] = *t;
 
-		fprintf(stream, "\n");
+	return CONFIG_OK;
+}
+
+/* lets transforms inject key-values at the end of current section */
+static ConfigRet PipelineEndSection(ConfigPipeline *pl)
+{
+	ConfigRet ret;
+	int       i;
+
+	if (pl->dropped)
+		return CONFIG_OK;
+
+	for (i = 0; i < pl->numoftransforms; ++i) {
+		if ( pl->transforms[i].on_section_end &&
+			 ((ret = pl->transforms[i].on_section_end(pl->transforms[i].arg,
+					pl->flat ? NULL : pl->sect, pl->w)) != CONFIG_OK) )
+			return ret;
 	}
 
 	return CONFIG_OK;
 }
 
-/**
- * \brief              ConfigPrintToFile() prints (saves) all cfg content to the file
- *
- * \param cfg          config handle
- * \param filename     filename to save in
- *
- * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
- */
-ConfigRet ConfigPrintToFile(const Config *cfg, char *filename)
+static ConfigRet PipelineOnSection(void *arg, const char *sect, int sect_len)
 {
-	FILE      *fp  = NULL;
-	ConfigRet  ret = CONFIG_OK;
+	ConfigPipeline *pl = arg;
+	const char     *name = sect;
+	char           *p;
+	size_t          len;
+	ConfigRet       ret;
+	int             i;
+
+	if ((ret = PipelineEndSection(pl)) != CONFIG_OK)
+		return ret;
 
-	if (!cfg || !filename)
-		return CONFIG_ERR_INVALID_PARAM;
+	pl->flat = false;
+	pl->dropped = false;
 
-	if ((fp = fopen(filename, "wb")) == NULL)
-		return CONFIG_ERR_FILE;
+	for (i = 0; (i < pl->numoftransforms) && !pl->dropped; ++i) {
+		if ( pl->transforms[i].on_section &&
+			 ((ret = pl->transforms[i].on_section(pl->transforms[i].arg, &name, &pl->dropped)) != CONFIG_OK) )
+			return ret;
+	}
 
-	ret = ConfigPrint(cfg, fp);
+	if (pl->dropped)
+		return CONFIG_OK;
 
-	fclose(fp);
+	/* name must outlive the parser line buffer */
+	if ((len = strlen(name) + 1) > pl->sectsize) {
+		if ((p = realloc(pl->sect, len)) == NULL)
+			return CONFIG_ERR_MEMALLOC;
+		pl->sect = p;
+		pl->sectsize = len;
+	}
+	memmove(pl->sect, name, len);
 
-	return ret;
+	return ConfigWriterSection(pl->w, pl->sect);
+}
+
+static ConfigRet PipelineOnKeyVal(void *arg, const char *key, int key_len, const char *val, int val_len)
+{
+	ConfigPipeline *pl = arg;
+	bool            drop = false;
+	ConfigRet       ret;
+	int             i;
+
+	if (pl->dropped)
+		return CONFIG_OK;
+
+	for (i = 0; (i < pl->numoftransforms) && !drop; ++i) {
+		if ( pl->transforms[i].on_keyval &&
+			 ((ret = pl->transforms[i].on_keyval(pl->transforms[i].arg, pl->flat ? NULL : pl->sect,
+					&key, &val, &drop)) != CONFIG_OK) )
+			return ret;
+	}
+
+	return drop ? CONFIG_OK : ConfigWriterKey(pl->w, key, val);
+}
+
+static ConfigRet PipelineOnInclude(void *arg, const char *path, int path_len)
+{
+	ConfigPipeline *pl = arg;
+
+	return pl->dropped ? CONFIG_OK : ConfigWriterInclude(pl->w, path);
 }
 
 /**
- * \brief              ConfigPrintSettings() prints settings to the stream
+ * \brief              ConfigPipelineRun() streams the input through the transforms to the
+ *                     output. Memory use does not depend on the size of the input.
  *
- * \param cfg          config handle
- * \param stream       stream to print
+ * \param pl           pipeline handle
+ * \param in           FILE handle to read
+ * \param cfg          config handle whose settings are used for parsing, NULL for defaults
+ * \param outfd        file descriptor to write to
  *
  * \return             Returns CONFIG_RET_OK as success, otherwise is an error.
  */
-ConfigRet ConfigPrintSettings(const Config *cfg, FILE *stream)
+ConfigRet ConfigPipelineRun(ConfigPipeline *pl, FILE *in, const Config *cfg, int outfd)
 {
-	if (!cfg || !stream)
+	ConfigHandlers handlers = { PipelineOnSection, PipelineOnKeyVal, PipelineOnInclude, NULL };
+	ConfigRet      ret, ret2;
+
+	if (!pl || !in)
 		return CONFIG_ERR_INVALID_PARAM;
 
-	fprintf(stream, "\n");
-	fprintf(stream, "Configuration settings: \n");
-	fprintf(stream, "   Comment characters : %s\n", cfg->comment_chars);
-	fprintf(stream, "   Key-Value seperator: %c\n", cfg->keyval_sep);
-	fprintf(stream, "   True-False strings : %s-%s\n", cfg->true_str, cfg->false_str);
-	fprintf(stream, "\n");
+	if ((pl->w = ConfigWriterOpen(outfd)) == NULL)
+		return (outfd < 0) ? CONFIG_ERR_INVALID_PARAM : CONFIG_ERR_MEMALLOC;
 
-	return CONFIG_OK;
-}
+	pl->flat = true;
+	pl->dropped = false;
+
+	if ((ret = ConfigParseStream(in, cfg, &handlers, pl)) == CONFIG_OK)
+		ret = PipelineEndSection(pl);
 
+	ret2 = ConfigWriterClose(pl->w);
+	pl->w = NULL;
+
+	return (ret != CONFIG_OK) ? ret : ret2;
+}
@@ -45,10 +45,25 @@ typedef unsigned char bool;
 
 
 typedef struct Config Config;
+typedef struct ConfigAsync ConfigAsync;
+typedef struct ConfigWriter ConfigWriter;
+typedef struct ConfigPipeline ConfigPipeline;
+typedef struct ConfigIntern ConfigIntern;
+typedef struct ConfigSubscription ConfigSubscription;
+typedef struct ConfigStore ConfigStore;
+typedef struct ConfigSchema ConfigSchema;
 
 
 #define CONFIG_SECTION_FLAT		NULL	/* config is flat data (has no section) */
 
+/* type of variables bound by ConfigBind*(), which are always written atomically */
+#if !defined(__cplusplus) && defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && \
+	!defined(__STDC_NO_ATOMICS__)
+# define CONFIG_ATOMIC(type)	_Atomic type
+#else
+# define CONFIG_ATOMIC(type)	volatile type
+#endif
+
 
 /**
  * \brief Return types
@@ -63,9 +78,158 @@ typedef enum
 	CONFIG_ERR_INVALID_PARAM,     /* invalid parametrs (as NULL) */
 	CONFIG_ERR_INVALID_VALUE,     /* value of key is invalid (inconsistent data, empty data) */
 	CONFIG_ERR_PARSING,           /* parsing error of data (does not fit to config format) */
+	CONFIG_ERR_CONFLICT,          /* key exists in both handles with different values */
 } ConfigRet;
 
 
+/**
+ * \brief Difference types reported by ConfigDiff()
+ */
+typedef enum
+{
+	CONFIG_DIFF_ADDED,            /* key exists only in the new config */
+	CONFIG_DIFF_REMOVED,          /* key exists only in the old config */
+	CONFIG_DIFF_CHANGED,          /* key exists in both configs with different values */
+} ConfigDiffType;
+
+/**
+ * \brief Conflict policies of ConfigMerge()
+ */
+typedef enum
+{
+	CONFIG_MERGE_OVERWRITE,       /* value of source config wins */
+	CONFIG_MERGE_KEEP,            /* value of destination config wins */
+	CONFIG_MERGE_ERROR,           /* differing values fail the merge */
+} ConfigMergePolicy;
+
+/**
+ * \brief Value types of ConfigSchemaKey
+ */
+typedef enum
+{
+	CONFIG_TYPE_STRING,           /* any value */
+	CONFIG_TYPE_INT,              /* as read by ConfigReadInt() */
+	CONFIG_TYPE_UNSIGNED_INT,     /* as read by ConfigReadUnsignedInt() */
+	CONFIG_TYPE_FLOAT,            /* as read by ConfigReadFloat() */
+	CONFIG_TYPE_DOUBLE,           /* as read by ConfigReadDouble() */
+	CONFIG_TYPE_BOOL,             /* as read by ConfigReadBool() */
+} ConfigType;
+
+/**
+ * \brief Rule of a key, see ConfigSchemaAddKey()
+ */
+typedef struct ConfigSchemaKey
+{
+	const char  *sect;
+	const char  *key;
+	ConfigType   type;
+	bool         required;        /* key must exist when a read is done */
+	bool         ranged;          /* numeric value must be within [min, max] */
+	double       min;
+	double       max;
+	const char **values;          /* NULL terminated set of allowed values, or NULL */
+	const char  *pattern;         /* POSIX extended regex the whole value must match, or NULL */
+} ConfigSchemaKey;
+
+typedef void (*ConfigDiffCallback)(ConfigDiffType type, const char *sect, const char *key,
+		const char *old_val, const char *new_val, void *arg);
+
+typedef ConfigRet (*ConfigValidator)(const Config *cfg, const char *sect, void *ctx);
+
+typedef void (*ConfigChangeCallback)(Config *cfg, const char *sect, const char *key,
+		int nchanges, void *ctx);
+
+/**
+ * \brief Handlers of ConfigParseStream()
+ */
+typedef struct ConfigHandlers
+{
+	ConfigRet (*on_section)(void *arg, const char *sect, int sect_len);
+	ConfigRet (*on_keyval) (void *arg, const char *key, int key_len, const char *val, int val_len);
+	ConfigRet (*on_include)(void *arg, const char *path, int path_len);
+	void      (*on_error)  (void *arg, int line, ConfigRet ret);
+} ConfigHandlers;
+
+/**
+ * \brief Transform of ConfigPipelineRun(). Callbacks may point *sect, *key and *val to
+ *        strings of their own which must stay valid until the next callback.
+ *        sect is NULL for key-values which are not under a section.
+ */
+typedef struct ConfigTransform
+{
+	ConfigRet (*on_section)    (void *arg, const char **sect, bool *drop);
+	ConfigRet (*on_keyval)     (void *arg, const char *sect, const char **key, const char **val, bool *drop);
+	ConfigRet (*on_section_end)(void *arg, const char *sect, ConfigWriter *w);
+	void       *arg;
+} ConfigTransform;
+
+typedef void (*ConfigAsyncCallback)(const char *filename, ConfigRet ret, Config *cfg, void *arg);
+
+/**
+ * \brief Runtime statistics of a config handle, see ConfigEnableStats()
+ */
+typedef struct ConfigStats
+{
+	unsigned long long lookups;         /* ConfigRead*() calls which searched for a key */
+	unsigned long long hits;            /* lookups which found the key */
+	unsigned long long miss_section;    /* lookups failed with CONFIG_ERR_NO_SECTION */
+	unsigned long long miss_key;        /* lookups failed with CONFIG_ERR_NO_KEY */
+	unsigned long long compares;        /* sections and keys compared by lookups */
+	unsigned long long parse_failures;  /* typed reads failed with CONFIG_ERR_INVALID_VALUE */
+	unsigned long long bytes_parsed;    /* bytes read by ConfigRead*() into the handle */
+	unsigned long long lines_parsed;    /* lines read by ConfigRead*() into the handle */
+	unsigned long long allocs;          /* allocations of sections, key-values and indexes */
+	unsigned long long alloc_bytes;     /* bytes requested by these allocations */
+} ConfigStats;
+
+/**
+ * \brief Time spent in each phase of ConfigReadWithTiming() and ConfigReadFileWithTiming()
+ */
+typedef struct ConfigTiming
+{
+	unsigned long long total_ns;        /* wall time of the whole read */
+	unsigned long long io_ns;           /* opening files and reading lines (fgets) */
+	unsigned long long tokenize_ns;     /* splitting lines into sections, keys and values */
+	unsigned long long section_ns;      /* resolving and creating sections (ConfigAddSection) */
+	unsigned long long insert_ns;       /* inserting key-values (ConfigAddString) */
+	unsigned long long alloc_ns;        /* allocations, also counted in section_ns and insert_ns */
+} ConfigTiming;
+
+/**
+ * \brief Memory used by a config or one of its sections, see ConfigGetMemoryUsage()
+ */
+typedef struct ConfigMemStats
+{
+	size_t nodes;                       /* Config, ConfigSection and ConfigKeyValue structs */
+	size_t keys;                        /* key and section name strings, except interned ones */
+	size_t values;                      /* value strings, except interned ones */
+	size_t indexes;                     /* section and key hash tables */
+	size_t slack;                       /* allocator overhead beyond the requested sizes */
+	size_t total;                       /* sum of all of the above */
+} ConfigMemStats;
+
+/**
+ * \brief Strings held by an intern table, see ConfigInternGetStats()
+ */
+typedef struct ConfigInternStats
+{
+	size_t strings;                     /* distinct strings in the table */
+	size_t refs;                        /* keys and values pointing to them */
+	size_t bytes;                       /* bytes of the distinct strings */
+	size_t saved;                       /* bytes the duplicate references would have needed */
+} ConfigInternStats;
+
+/**
+ * \brief Version of a config store, see ConfigHistory()
+ */
+typedef struct ConfigVersion
+{
+	unsigned long long version;         /* number returned by ConfigPublish() */
+	unsigned long long time;            /* publish time (ns since epoch) */
+	bool current;                       /* version got by ConfigStoreGet() */
+} ConfigVersion;
+
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -80,13 +244,86 @@ const char *ConfigRetToString      (ConfigRet ret);
 
 ConfigRet   ConfigRead             (FILE *fp, Config **cfg);
 ConfigRet   ConfigReadFile         (const char *filename, Config **cfg);
+ConfigRet   ConfigReadWithTiming   (FILE *fp, Config **cfg, ConfigTiming *timing);
+ConfigRet   ConfigReadFileWithTiming(const char *filename, Config **cfg, ConfigTiming *timing);
+ConfigRet   ConfigParseStream      (FILE *fp, const Config *cfg, const ConfigHandlers *handlers, void *arg);
+ConfigRet   ConfigReadFiles        (const char **paths, int n, Config **cfgs, ConfigRet *rets, int nthreads);
+ConfigRet   ConfigReadDirectory    (const char *path, const char *pattern, Config **cfg);
+
+ConfigRet   ConfigOpenShared       (const char *filename, const Config **cfg);
+void        ConfigRelease          (const Config *cfg);
+
+ConfigStore* ConfigStoreNew        (int depth);
+void        ConfigStoreFree        (ConfigStore *store);
+ConfigRet   ConfigPublish          (ConfigStore *store, Config *cfg, unsigned long long *version);
+ConfigRet   ConfigStoreGet         (ConfigStore *store, const Config **cfg);
+ConfigRet   ConfigRollback         (ConfigStore *store, unsigned long long version);
+int         ConfigHistory          (ConfigStore *store, ConfigVersion *versions, int n);
+ConfigRet   ConfigStoreAddValidator(ConfigStore *store, const char *sect, ConfigValidator validator, void *ctx);
+ConfigRet   ConfigStoreReload      (ConfigStore *store, const char *filename, int nthreads, unsigned long long *version);
+
+ConfigSchema* ConfigSchemaNew      (void);
+void        ConfigSchemaFree       (ConfigSchema *schema);
+ConfigRet   ConfigSchemaAddKey     (ConfigSchema *schema, const ConfigSchemaKey *rule);
+ConfigRet   ConfigSetSchema        (Config *cfg, const ConfigSchema *schema);
+const char *ConfigGetSchemaError   (const Config *cfg);
+
+ConfigAsync* ConfigAsyncNew        (int nthreads);
+void        ConfigAsyncFree        (ConfigAsync *async);
+ConfigRet   ConfigReadFileAsync    (ConfigAsync *async, const char *filename, ConfigAsyncCallback callback, void *arg);
+int         ConfigAsyncPoll        (ConfigAsync *async, bool wait);
+int         ConfigAsyncPending     (ConfigAsync *async);
 
 ConfigRet   ConfigPrint            (const Config *cfg, FILE *stream);
 ConfigRet   ConfigPrintToFile      (const Config *cfg, char *filename);
 ConfigRet   ConfigPrintSettings    (const Config *cfg, FILE *stream);
 
+ConfigWriter* ConfigWriterOpen     (int fd);
+ConfigRet   ConfigWriterClose      (ConfigWriter *w);
+ConfigRet   ConfigWriterSection    (ConfigWriter *w, const char *sect);
+ConfigRet   ConfigWriterKey        (ConfigWriter *w, const char *key, const char *val);
+ConfigRet   ConfigWriterKeyInt     (ConfigWriter *w, const char *key, int          val);
+ConfigRet   ConfigWriterKeyUnsignedInt(ConfigWriter *w, const char *key, unsigned int val);
+ConfigRet   ConfigWriterKeyFloat   (ConfigWriter *w, const char *key, float        val);
+ConfigRet   ConfigWriterKeyDouble  (ConfigWriter *w, const char *key, double       val);
+ConfigRet   ConfigWriterKeyBool    (ConfigWriter *w, const char *key, bool         val);
+ConfigRet   ConfigWriterInclude    (ConfigWriter *w, const char *path);
+
+ConfigPipeline* ConfigPipelineNew  (void);
+void        ConfigPipelineFree     (ConfigPipeline *pl);
+ConfigRet   ConfigPipelineAdd      (ConfigPipeline *pl, const ConfigTransform *t);
+ConfigRet   ConfigPipelineRun      (ConfigPipeline *pl, FILE *in, const Config *cfg, int outfd);
+
 int         ConfigGetSectionCount  (const Config *cfg);
 int         ConfigGetKeyCount      (const Config *cfg, const char *sect);
+ConfigRet   ConfigGetMemoryUsage   (const Config *cfg, ConfigMemStats *mem);
+ConfigRet   ConfigGetSectionMemoryUsage(const Config *cfg, const char *sect, ConfigMemStats *mem);
+
+ConfigRet   ConfigEnableStats      (Config *cfg, bool enable);
+ConfigRet   ConfigGetStats         (const Config *cfg, ConfigStats *stats);
+ConfigRet   ConfigResetStats       (Config *cfg);
+
+ConfigRet   ConfigEnableAccessProfile(Config *cfg, unsigned int period);
+ConfigRet   ConfigDumpAccessProfile(const Config *cfg, FILE *stream);
+ConfigRet   ConfigSaveAccessProfile(const Config *cfg, const char *filename);
+ConfigRet   ConfigLoadAccessProfile(Config *cfg, const char *filename);
+ConfigRet   ConfigRelayout         (Config *cfg);
+
+ConfigIntern* ConfigInternNew      (void);
+void        ConfigInternFree       (ConfigIntern *intern);
+ConfigRet   ConfigInternGetStats   (ConfigIntern *intern, ConfigInternStats *stats);
+ConfigRet   ConfigSetIntern        (Config *cfg, ConfigIntern *intern);
+
+ConfigSubscription* ConfigSubscribe(Config *cfg, const char *sect, const char *key, ConfigChangeCallback callback, void *ctx);
+ConfigRet   ConfigUnsubscribe      (Config *cfg, ConfigSubscription *sub);
+ConfigRet   ConfigBeginUpdate      (Config *cfg);
+ConfigRet   ConfigEndUpdate        (Config *cfg);
+
+ConfigSubscription* ConfigBindInt  (Config *cfg, const char *sect, const char *key, CONFIG_ATOMIC(int) *         val, int          dfl_val);
+ConfigSubscription* ConfigBindUnsignedInt(Config *cfg, const char *sect, const char *key, CONFIG_ATOMIC(unsigned int) *val, unsigned int dfl_val);
+ConfigSubscription* ConfigBindFloat(Config *cfg, const char *sect, const char *key, CONFIG_ATOMIC(float) *       val, float        dfl_val);
+ConfigSubscription* ConfigBindDouble(Config *cfg, const char *sect, const char *key, CONFIG_ATOMIC(double) *      val, double       dfl_val);
+ConfigSubscription* ConfigBindBool (Config *cfg, const char *sect, const char *key, CONFIG_ATOMIC(bool) *        val, bool         dfl_val);
 
 ConfigRet   ConfigSetCommentCharset(Config *cfg, const char *comment_ch);
 ConfigRet   ConfigSetKeyValSepChar (Config *cfg, char ch);
@@ -111,6 +348,9 @@ bool        ConfigHasSection       (const Config *cfg, const char *sect);
 ConfigRet   ConfigRemoveSection    (Config *cfg, const char *sect);
 ConfigRet   ConfigRemoveKey        (Config *cfg, const char *sect, const char *key);
 
+ConfigRet   ConfigDiff             (const Config *cfg1, const Config *cfg2, ConfigDiffCallback callback, void *arg);
+ConfigRet   ConfigMerge            (Config *dst, Config *src, ConfigMergePolicy policy);
+
 
 #ifdef __cplusplus
 }
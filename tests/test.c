@@ -5,6 +5,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "../src/configini.h"
 
@@ -18,6 +21,10 @@
 
 #define CONFIGREADFILE		"../etc/config.cnf"
 #define CONFIGSAVEFILE		"../etc/new-config.cnf"
+#define CONFIGREADDIR		"../etc/conf.d"
+#define CONFIGINCLUDEFILE	"../etc/include.cnf"
+#define CONFIGCYCLEFILE		"../etc/include/cycle-a.cnf"
+#define CONFIGPROFILEFILE	"../etc/access-profile.cnf"
 
 #define ENTER_TEST_FUNC														\
 	do {																	\
@@ -147,6 +154,842 @@ static void Test4()
 	ConfigFree(cfg);
 }
 
+/*
+ * Diff two Config handles
+ */
+static void DiffPrint(ConfigDiffType type, const char *sect, const char *key,
+		const char *old_val, const char *new_val, void *arg)
+{
+	static const char *types[] = { "added", "removed", "changed" };
+
+	LOG_INFO("%-8s [%s] %s : %s -> %s", types[type], sect ? sect : "", key,
+			old_val ? old_val : "", new_val ? new_val : "");
+}
+
+static void Test5()
+{
+	Config *cfg1 = NULL;
+	Config *cfg2 = NULL;
+
+	ENTER_TEST_FUNC;
+
+	if ( (ConfigReadFile(CONFIGREADFILE, &cfg1) != CONFIG_OK) ||
+		 (ConfigReadFile(CONFIGREADFILE, &cfg2) != CONFIG_OK) ) {
+		LOG_ERR("ConfigOpenFile failed for %s", CONFIGREADFILE);
+		ConfigFree(cfg1);
+		return;
+	}
+
+	ConfigRemoveKey    (cfg2, "SECT1", "a");
+	ConfigAddInt       (cfg2, "SECT2", "bb", 23);
+	ConfigAddString    (cfg2, "OWNER", "country", "Turkey");
+	ConfigRemoveSection(cfg2, "database");
+	ConfigAddBool      (cfg2, "logging", "enable", true);
+
+	ConfigDiff(cfg1, cfg2, DiffPrint, NULL);
+
+	ConfigFree(cfg1);
+	ConfigFree(cfg2);
+}
+
+/*
+ * Merge one Config handle into another
+ */
+static void Test6()
+{
+	Config *cfg = NULL;
+	Config *frag = NULL;
+
+	ENTER_TEST_FUNC;
+
+	if (ConfigReadFile(CONFIGREADFILE, &cfg) != CONFIG_OK) {
+		LOG_ERR("ConfigOpenFile failed for %s", CONFIGREADFILE);
+		return;
+	}
+
+	frag = ConfigNew();
+	ConfigAddInt   (frag, "database", "port", 6666);
+	ConfigAddString(frag, "database", "user", "admin");
+	ConfigAddBool  (frag, "logging", "enable", true);
+
+	LOG_INFO("merge (error policy) : %s", ConfigRetToString(ConfigMerge(cfg, frag, CONFIG_MERGE_ERROR)));
+	LOG_INFO("merge (overwrite)    : %s", ConfigRetToString(ConfigMerge(cfg, frag, CONFIG_MERGE_OVERWRITE)));
+
+	ConfigPrint(cfg, stdout);
+
+	ConfigFree(frag);
+	ConfigFree(cfg);
+}
+
+/*
+ * Read conf.d directory
+ */
+static void Test7()
+{
+	Config *cfg = NULL;
+
+	ENTER_TEST_FUNC;
+
+	if (ConfigReadDirectory(CONFIGREADDIR, "*.cnf", &cfg) != CONFIG_OK) {
+		LOG_ERR("ConfigReadDirectory failed for %s", CONFIGREADDIR);
+		return;
+	}
+
+	ConfigPrint(cfg, stdout);
+
+	ConfigFree(cfg);
+}
+
+/*
+ * Read Config file with include directives
+ */
+static void Test8()
+{
+	Config   *cfg = NULL;
+	ConfigRet ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((ret = ConfigReadFile(CONFIGINCLUDEFILE, &cfg)) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFile failed for %s : %s", CONFIGINCLUDEFILE, ConfigRetToString(ret));
+		return;
+	}
+
+	ConfigPrint(cfg, stdout);
+	ConfigFree(cfg);
+	cfg = NULL;
+
+	ret = ConfigReadFile(CONFIGCYCLEFILE, &cfg);
+	LOG_INFO("include cycle : %s", ConfigRetToString(ret));
+}
+
+/*
+ * Read Config files asynchronously
+ */
+static void AsyncLoaded(const char *filename, ConfigRet ret, Config *cfg, void *arg)
+{
+	LOG_INFO("%s : %s, %d sections", filename, ConfigRetToString(ret), ConfigGetSectionCount(cfg));
+
+	ConfigFree(cfg);
+}
+
+static void Test9()
+{
+	ConfigAsync *async = NULL;
+
+	ENTER_TEST_FUNC;
+
+	if ((async = ConfigAsyncNew(0)) == NULL) {
+		LOG_ERR("%s", "ConfigAsyncNew failed");
+		return;
+	}
+
+	ConfigReadFileAsync(async, CONFIGREADFILE, AsyncLoaded, NULL);
+	ConfigReadFileAsync(async, CONFIGINCLUDEFILE, AsyncLoaded, NULL);
+	ConfigReadFileAsync(async, CONFIGCYCLEFILE, AsyncLoaded, NULL);
+
+	while (ConfigAsyncPending(async) > 0)
+		ConfigAsyncPoll(async, true);
+
+	ConfigAsyncFree(async);
+}
+
+/*
+ * Parse Config file without building a Config handle
+ */
+static ConfigRet OnSection(void *arg, const char *sect, int sect_len)
+{
+	LOG_INFO("section : %.*s", sect_len, sect);
+	return CONFIG_OK;
+}
+
+static ConfigRet OnKeyVal(void *arg, const char *key, int key_len, const char *val, int val_len)
+{
+	++*(int *) arg;
+	return CONFIG_OK;
+}
+
+static void OnError(void *arg, int line, ConfigRet ret)
+{
+	LOG_ERR("line %d : %s", line, ConfigRetToString(ret));
+}
+
+static void Test10()
+{
+	ConfigHandlers handlers = { OnSection, OnKeyVal, NULL, OnError };
+	FILE          *fp = NULL;
+	int            numofkv = 0;
+
+	ENTER_TEST_FUNC;
+
+	if ((fp = fopen(CONFIGREADFILE, "r")) == NULL) {
+		LOG_ERR("fopen failed for %s", CONFIGREADFILE);
+		return;
+	}
+
+	ConfigParseStream(fp, NULL, &handlers, &numofkv);
+	LOG_INFO("%d key-values", numofkv);
+
+	fclose(fp);
+}
+
+/*
+ * Write Config file without building a Config handle
+ */
+static void Test11()
+{
+	ConfigWriter *w = NULL;
+
+	ENTER_TEST_FUNC;
+
+	fflush(stdout);
+
+	if ((w = ConfigWriterOpen(STDOUT_FILENO)) == NULL) {
+		LOG_ERR("%s", "ConfigWriterOpen failed");
+		return;
+	}
+
+	ConfigWriterKey       (w, "generator", "Test11");
+	ConfigWriterSection   (w, "SECTION1");
+	ConfigWriterKey       (w, "Istanbul", "34");
+	ConfigWriterKeyInt    (w, "Malatya", 44);
+	ConfigWriterSection   (w, "SECTION2");
+	ConfigWriterKeyBool   (w, "enable", true);
+	ConfigWriterKeyDouble (w, "Lira", 100);
+
+	ConfigWriterClose(w);
+}
+
+/*
+ * Transform Config file while streaming
+ */
+static ConfigRet RenameSection(void *arg, const char **sect, bool *drop)
+{
+	if (!strcmp(*sect, "OWNER"))
+		*sect = "owner";
+	else if (!strcmp(*sect, "database"))
+		*drop = true;
+
+	return CONFIG_OK;
+}
+
+static ConfigRet RewriteKey(void *arg, const char *sect, const char **key, const char **val, bool *drop)
+{
+	if (sect && !strcmp(sect, "SECT1") && !strcmp(*key, "a"))
+		*drop = true;
+	else if (sect && !strcmp(sect, "owner") && !strcmp(*key, "title"))
+		*val = "Senior Software Engineer";
+
+	return CONFIG_OK;
+}
+
+static ConfigRet InjectKey(void *arg, const char *sect, ConfigWriter *w)
+{
+	if (sect && !strcmp(sect, "owner"))
+		return ConfigWriterKey(w, "country", "Turkey");
+
+	return CONFIG_OK;
+}
+
+static void Test12()
+{
+	ConfigTransform  t  = { RenameSection, RewriteKey, InjectKey, NULL };
+	ConfigPipeline  *pl = NULL;
+	FILE            *fp = NULL;
+	ConfigRet        ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((fp = fopen(CONFIGREADFILE, "r")) == NULL) {
+		LOG_ERR("fopen failed for %s", CONFIGREADFILE);
+		return;
+	}
+
+	pl = ConfigPipelineNew();
+	ConfigPipelineAdd(pl, &t);
+
+	fflush(stdout);
+	if ((ret = ConfigPipelineRun(pl, fp, NULL, STDOUT_FILENO)) != CONFIG_OK)
+		LOG_ERR("ConfigPipelineRun failed : %s", ConfigRetToString(ret));
+
+	ConfigPipelineFree(pl);
+	fclose(fp);
+}
+
+/*
+ * Runtime statistics of Config handle
+ */
+static void Test13()
+{
+	Config      *cfg = NULL;
+	ConfigStats  st;
+	int          i;
+
+	ENTER_TEST_FUNC;
+
+	if ( ((cfg = ConfigNew()) == NULL) || (ConfigEnableStats(cfg, true) != CONFIG_OK) ) {
+		LOG_ERR("%s", "ConfigEnableStats failed");
+		ConfigFree(cfg);
+		return;
+	}
+
+	if (ConfigReadFile(CONFIGREADFILE, &cfg) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFile failed for %s", CONFIGREADFILE);
+		ConfigFree(cfg);
+		return;
+	}
+
+	ConfigReadInt(cfg, "SECT1", "a", &i, 0);
+	ConfigReadInt(cfg, "SECT1", "nokey", &i, 0);
+	ConfigReadInt(cfg, "NOSECT", "a", &i, 0);
+	ConfigReadInt(cfg, "OWNER", "name", &i, 0);
+
+	ConfigGetStats(cfg, &st);
+	LOG_INFO("lookups %llu, hits %llu, no section %llu, no key %llu, compares %llu, parse failures %llu",
+			st.lookups, st.hits, st.miss_section, st.miss_key, st.compares, st.parse_failures);
+	LOG_INFO("parsed %llu bytes, %llu lines, %llu allocations of %llu bytes",
+			st.bytes_parsed, st.lines_parsed, st.allocs, st.alloc_bytes);
+
+	ConfigResetStats(cfg);
+	ConfigGetStats(cfg, &st);
+	LOG_INFO("lookups after reset %llu", st.lookups);
+
+	ConfigFree(cfg);
+}
+
+/*
+ * Access profile of Config handle
+ */
+static void Test14()
+{
+	Config *cfg = NULL;
+	char    s[256];
+	int     i, j;
+
+	ENTER_TEST_FUNC;
+
+	if (ConfigReadFile(CONFIGREADFILE, &cfg) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFile failed for %s", CONFIGREADFILE);
+		return;
+	}
+
+	ConfigEnableAccessProfile(cfg, 1);
+
+	for (i = 0; i < 100; ++i)
+		ConfigReadInt(cfg, "SECT1", "a", &j, 0);
+	for (i = 0; i < 10; ++i)
+		ConfigReadString(cfg, "OWNER", "name", s, sizeof(s), "");
+	ConfigReadInt(cfg, "database", "port", &j, 0);
+
+	ConfigDumpAccessProfile(cfg, stdout);
+
+	/* a single read is listed as read even if it is not sampled */
+	ConfigEnableAccessProfile(cfg, 64);
+	ConfigReadString(cfg, "OWNER", "title", s, sizeof(s), "");
+
+	ConfigDumpAccessProfile(cfg, stdout);
+
+	ConfigFree(cfg);
+}
+
+/*
+ * Profile guided layout of Config handle
+ */
+static void Test15()
+{
+	Config *cfg = NULL, *cfg2 = NULL;
+	char    s[256];
+	int     i, j;
+
+	ENTER_TEST_FUNC;
+
+	if (ConfigReadFile(CONFIGREADFILE, &cfg) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFile failed for %s", CONFIGREADFILE);
+		return;
+	}
+
+	ConfigEnableAccessProfile(cfg, 1);
+	for (i = 0; i < 10; ++i)
+		ConfigReadInt(cfg, "database", "port", &j, 0);
+	ConfigReadString(cfg, "OWNER", "name", s, sizeof(s), "");
+
+	if (ConfigSaveAccessProfile(cfg, CONFIGPROFILEFILE) != CONFIG_OK) {
+		LOG_ERR("ConfigSaveAccessProfile failed for %s", CONFIGPROFILEFILE);
+		ConfigFree(cfg);
+		return;
+	}
+	ConfigFree(cfg);
+	cfg = NULL;
+
+	/* lay out a freshly loaded config with the saved profile */
+	ConfigReadFile(CONFIGREADFILE, &cfg);
+	ConfigLoadAccessProfile(cfg, CONFIGPROFILEFILE);
+	unlink(CONFIGPROFILEFILE);
+
+	if (ConfigRelayout(cfg) != CONFIG_OK) {
+		LOG_ERR("%s", "ConfigRelayout failed");
+		ConfigFree(cfg);
+		return;
+	}
+
+	ConfigReadInt(cfg, "database", "port", &j, 0);
+	LOG_INFO("database.port : %d", j);
+
+	ConfigAddString(cfg, "OWNER", "name", "Taner");
+	ConfigRemoveKey(cfg, "SECT1", "a");
+	ConfigRelayout(cfg);
+
+	cfg2 = ConfigNew();
+	ConfigAddString(cfg2, "database", "port", "6666");
+	ConfigMerge(cfg2, cfg, CONFIG_MERGE_OVERWRITE);
+	ConfigFree(cfg);
+
+	ConfigPrint(cfg2, stdout);
+	ConfigFree(cfg2);
+}
+
+/*
+ * Read Config file with per phase timing
+ */
+static void Test16()
+{
+	Config       *cfg = NULL;
+	ConfigTiming  tm;
+	ConfigRet     ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((ret = ConfigReadFileWithTiming(CONFIGINCLUDEFILE, &cfg, &tm)) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFileWithTiming failed for %s : %s", CONFIGINCLUDEFILE, ConfigRetToString(ret));
+		return;
+	}
+
+	LOG_INFO("total %llu ns : io %llu, tokenize %llu, section %llu, insert %llu, alloc %llu",
+			tm.total_ns, tm.io_ns, tm.tokenize_ns, tm.section_ns, tm.insert_ns, tm.alloc_ns);
+
+	ConfigFree(cfg);
+}
+
+static void PrintMemoryUsage(const char *what, const ConfigMemStats *mem)
+{
+	LOG_INFO("%s: total %zu : nodes %zu, keys %zu, values %zu, indexes %zu, slack %zu",
+			what, mem->total, mem->nodes, mem->keys, mem->values, mem->indexes, mem->slack);
+}
+
+/*
+ * Memory usage of config and one section, before and after removing a key
+ */
+static void Test17()
+{
+	Config         *cfg = NULL;
+	ConfigMemStats  mem;
+	ConfigRet       ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((ret = ConfigReadFile(CONFIGREADFILE, &cfg)) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFile failed for %s : %s", CONFIGREADFILE, ConfigRetToString(ret));
+		return;
+	}
+
+	ConfigGetMemoryUsage(cfg, &mem);
+	PrintMemoryUsage("config", &mem);
+	ConfigGetSectionMemoryUsage(cfg, "SECT1", &mem);
+	PrintMemoryUsage("SECT1", &mem);
+
+	ConfigRemoveKey(cfg, "SECT1", "a");
+
+	ConfigGetMemoryUsage(cfg, &mem);
+	PrintMemoryUsage("config after remove", &mem);
+	ConfigGetSectionMemoryUsage(cfg, "SECT1", &mem);
+	PrintMemoryUsage("SECT1 after remove", &mem);
+
+	ConfigFree(cfg);
+}
+
+static void PrintInternStats(const char *what, ConfigIntern *intern)
+{
+	ConfigInternStats st;
+
+	ConfigInternGetStats(intern, &st);
+	LOG_INFO("%s: %zu strings, %zu refs, %zu bytes, %zu bytes saved",
+			what, st.strings, st.refs, st.bytes, st.saved);
+}
+
+/*
+ * Two configs sharing an intern table
+ */
+static void Test18()
+{
+	Config        *cfg1 = NULL, *cfg2 = NULL;
+	ConfigIntern  *intern;
+	ConfigRet      ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((intern = ConfigInternNew()) == NULL) {
+		LOG_ERR("%s", "ConfigInternNew failed");
+		return;
+	}
+
+	cfg1 = ConfigNew();
+	cfg2 = ConfigNew();
+	ConfigSetIntern(cfg1, intern);
+	ConfigSetIntern(cfg2, intern);
+	ConfigInternFree(intern);
+
+	if ( ((ret = ConfigReadFile(CONFIGREADFILE, &cfg1)) != CONFIG_OK) ||
+		 ((ret = ConfigReadFile(CONFIGREADFILE, &cfg2)) != CONFIG_OK) ) {
+		LOG_ERR("ConfigReadFile failed for %s : %s", CONFIGREADFILE, ConfigRetToString(ret));
+		goto out;
+	}
+
+	ConfigAddString(cfg1, "SECT1", "f", "1");
+	PrintInternStats("two configs", intern);
+
+	ConfigFree(cfg1);
+	cfg1 = NULL;
+	PrintInternStats("one config", intern);
+
+	ConfigPrint(cfg2, stdout);
+
+out:
+	ConfigFree(cfg1);
+	ConfigFree(cfg2);
+}
+
+static void OnChange(Config *cfg, const char *sect, const char *key, int nchanges, void *ctx)
+{
+	LOG_INFO("%s: [%s] %s changed %d time(s)", (const char *) ctx, sect ? sect : "", key, nchanges);
+}
+
+/*
+ * Subscriptions to a key, a key prefix and a whole section
+ */
+static void Test19()
+{
+	Config    *cfg = NULL;
+	ConfigRet  ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((ret = ConfigReadFile(CONFIGREADFILE, &cfg)) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFile failed for %s : %s", CONFIGREADFILE, ConfigRetToString(ret));
+		return;
+	}
+
+	ConfigSubscribe(cfg, "SECT1", "a", OnChange, "key");
+	ConfigSubscribe(cfg, "SECT2", "a*", OnChange, "prefix");
+	ConfigSubscribe(cfg, "OWNER", NULL, OnChange, "section");
+
+	LOG_INFO("%s", "unchanged value");
+	ConfigAddString(cfg, "SECT1", "a", "1");
+
+	LOG_INFO("%s", "single change");
+	ConfigAddInt(cfg, "SECT1", "a", 2);
+
+	LOG_INFO("%s", "update");
+	ConfigBeginUpdate(cfg);
+	ConfigAddString(cfg, "SECT2", "aa", "12");
+	ConfigAddString(cfg, "SECT2", "ab", "1");
+	ConfigAddString(cfg, "SECT2", "bb", "23");
+	ConfigEndUpdate(cfg);
+
+	LOG_INFO("%s", "reload");
+	ConfigReadFile(CONFIGREADFILE, &cfg);
+
+	LOG_INFO("%s", "remove section");
+	ConfigRemoveSection(cfg, "OWNER");
+
+	ConfigFree(cfg);
+}
+
+/*
+ * Variables bound to keys
+ */
+static void Test20()
+{
+	Config                *cfg = NULL;
+	CONFIG_ATOMIC(int)     a;
+	CONFIG_ATOMIC(double)  port;
+	CONFIG_ATOMIC(bool)    missing;
+	ConfigRet              ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((ret = ConfigReadFile(CONFIGREADFILE, &cfg)) != CONFIG_OK) {
+		LOG_ERR("ConfigReadFile failed for %s : %s", CONFIGREADFILE, ConfigRetToString(ret));
+		return;
+	}
+
+	ConfigBindInt(cfg, "SECT1", "a", &a, -1);
+	ConfigBindDouble(cfg, "database", "port", &port, 0.0);
+	ConfigBindBool(cfg, "SECT1", "missing", &missing, false);
+	LOG_INFO("bound : a = %d, port = %.1f, missing = %d", (int) a, (double) port, (int) missing);
+
+	ConfigBeginUpdate(cfg);
+	ConfigAddInt(cfg, "SECT1", "a", 7);
+	ConfigAddDouble(cfg, "database", "port", 6666);
+	ConfigAddBool(cfg, "SECT1", "missing", true);
+	LOG_INFO("update: a = %d, port = %.1f, missing = %d", (int) a, (double) port, (int) missing);
+	ConfigEndUpdate(cfg);
+	LOG_INFO("done  : a = %d, port = %.1f, missing = %d", (int) a, (double) port, (int) missing);
+
+	ConfigAddString(cfg, "SECT1", "a", "12abc");
+	ConfigAddString(cfg, "database", "port", "1.5x");
+	LOG_INFO("invalid: a = %d, port = %.1f", (int) a, (double) port);
+
+	ConfigRemoveKey(cfg, "SECT1", "a");
+	LOG_INFO("remove: a = %d", (int) a);
+
+	ConfigFree(cfg);
+}
+
+/*
+ * Version history of 3 configs, rollback
+ */
+static void Test21()
+{
+	ConfigStore        *store;
+	Config             *cfg;
+	const Config       *cur = NULL;
+	ConfigVersion       versions[4];
+	unsigned long long  v;
+	int                 i, n, a;
+
+	ENTER_TEST_FUNC;
+
+	if ((store = ConfigStoreNew(3)) == NULL) {
+		LOG_ERR("%s", "ConfigStoreNew failed");
+		return;
+	}
+
+	for (i = 1; i <= 4; ++i) {
+		cfg = NULL;
+		if (ConfigReadFile(CONFIGREADFILE, &cfg) != CONFIG_OK) {
+			LOG_ERR("ConfigReadFile failed for %s", CONFIGREADFILE);
+			break;
+		}
+		ConfigAddInt(cfg, "SECT1", "a", i * 100);
+		ConfigPublish(store, cfg, &v);
+		LOG_INFO("published version %llu", v);
+	}
+
+	n = ConfigHistory(store, versions, 4);
+	for (i = 0; i < n; ++i)
+		LOG_INFO("version %llu%s", versions[i].version, versions[i].current ? " (current)" : "");
+
+	LOG_INFO("rollback to 2 : %s", ConfigRetToString(ConfigRollback(store, 2)));
+	LOG_INFO("rollback to 1 : %s", ConfigRetToString(ConfigRollback(store, 1)));
+
+	if (ConfigStoreGet(store, &cur) == CONFIG_OK) {
+		ConfigReadInt(cur, "SECT1", "a", &a, 0);
+		LOG_INFO("current a = %d", a);
+	}
+
+	ConfigStoreFree(store);
+	ConfigRelease(cur);
+}
+
+static ConfigRet ValidatePort(const Config *cfg, const char *sect, void *ctx)
+{
+	int port;
+
+	if (ConfigReadInt(cfg, sect, "port", &port, 0) != CONFIG_OK)
+		return CONFIG_ERR_NO_KEY;
+
+	return ((port > 0) && (port < 65536)) ? CONFIG_OK : CONFIG_ERR_INVALID_VALUE;
+}
+
+static ConfigRet ValidateKeyCount(const Config *cfg, const char *sect, void *ctx)
+{
+	return (ConfigGetKeyCount(cfg, sect) <= *(int *) ctx) ? CONFIG_OK : CONFIG_ERR_INVALID_VALUE;
+}
+
+/*
+ * Reload of a config store with validators
+ */
+static void Test22()
+{
+	ConfigStore        *store;
+	ConfigVersion       versions[2];
+	unsigned long long  v = 0;
+	int                 maxkeys = 8;
+	int                 n;
+
+	ENTER_TEST_FUNC;
+
+	if ((store = ConfigStoreNew(2)) == NULL) {
+		LOG_ERR("%s", "ConfigStoreNew failed");
+		return;
+	}
+
+	ConfigStoreAddValidator(store, "database", ValidatePort, NULL);
+	ConfigStoreAddValidator(store, "*", ValidateKeyCount, &maxkeys);
+
+	LOG_INFO("reload : %s", ConfigRetToString(ConfigStoreReload(store, CONFIGREADFILE, 0, &v)));
+
+	maxkeys = 2;
+	LOG_INFO("reload with 2 keys at most : %s",
+			ConfigRetToString(ConfigStoreReload(store, CONFIGREADFILE, 0, &v)));
+
+	n = ConfigHistory(store, versions, 2);
+	LOG_INFO("%d version(s), current is %llu", n, v);
+
+	ConfigStoreFree(store);
+}
+
+/* reads the directory if dir is not NULL, otherwise CONFIGREADFILE */
+static void ReadWithSchema(const ConfigSchema *schema, const char *dir)
+{
+	Config    *cfg = ConfigNew();
+	ConfigRet  ret;
+
+	ConfigSetSchema(cfg, schema);
+
+	if (dir)
+		ret = ConfigReadDirectory(dir, "*.cnf", &cfg);
+	else
+		ret = ConfigReadFile(CONFIGREADFILE, &cfg);
+
+	if (ret != CONFIG_OK)
+		LOG_INFO("rejected : %s : %s", ConfigRetToString(ret), ConfigGetSchemaError(cfg));
+	else
+		LOG_INFO("%s", "accepted");
+
+	ConfigFree(cfg);
+}
+
+/*
+ * Read Config file checked by a schema
+ */
+static void Test23()
+{
+	static const char *names[] = { "Taner", "Taner YILMAZ", NULL };
+	static const char *levels[] = { "info", "warning", "error", NULL };
+	ConfigSchema      *schema;
+	ConfigSchemaKey    port  = { .sect = "database", .key = "port", .type = CONFIG_TYPE_INT,
+	                             .required = true, .ranged = true, .min = 1, .max = 65535 };
+	ConfigSchemaKey    name  = { .sect = "OWNER", .key = "name", .values = names };
+	ConfigSchemaKey    title = { .sect = "OWNER", .key = "title", .pattern = "[A-Za-z ]+" };
+	ConfigSchemaKey    cc    = { .sect = "SECT2", .key = "cc", .type = CONFIG_TYPE_UNSIGNED_INT,
+	                             .ranged = true, .min = 0, .max = 10 };
+	ConfigSchemaKey    user  = { .sect = "database", .key = "user", .required = true };
+	ConfigSchemaKey    level = { .sect = "logging", .key = "level", .values = levels };
+	ConfigSchemaKey    ratio = { .sect = "SECT2", .key = "ratio", .type = CONFIG_TYPE_FLOAT };
+	Config            *cfg;
+	ConfigRet          ret;
+
+	ENTER_TEST_FUNC;
+
+	if ((schema = ConfigSchemaNew()) == NULL) {
+		LOG_ERR("%s", "ConfigSchemaNew failed");
+		return;
+	}
+
+	ConfigSchemaAddKey(schema, &port);
+	ConfigSchemaAddKey(schema, &name);
+	ConfigSchemaAddKey(schema, &title);
+	ReadWithSchema(schema, NULL);
+
+	ConfigSchemaAddKey(schema, &cc);
+	ReadWithSchema(schema, NULL);
+
+	cc.max = 100;
+	ConfigSchemaAddKey(schema, &cc);
+	ConfigSchemaAddKey(schema, &user);
+	ReadWithSchema(schema, NULL);
+
+	/* error of a fragment names the file */
+	ConfigSchemaAddKey(schema, &level);
+	ReadWithSchema(schema, CONFIGREADDIR);
+
+	/* a double which does not fit in a float is rejected */
+	ConfigSchemaAddKey(schema, &ratio);
+	if ((cfg = ConfigNew()) != NULL) {
+		ConfigSetSchema(cfg, schema);
+		ret = ConfigAddString(cfg, "SECT2", "ratio", "1e39");
+		LOG_INFO("ratio=1e39 : %s : %s", ConfigRetToString(ret), ConfigGetSchemaError(cfg));
+		ConfigFree(cfg);
+	}
+
+	ConfigSchemaFree(schema);
+}
+
+/*
+ * Read a batch of files concurrently, one of them missing
+ */
+static void Test24()
+{
+	const char *paths[] = { CONFIGREADFILE, "../etc/missing.cnf", CONFIGINCLUDEFILE };
+	Config     *cfgs[3] = { NULL, NULL, NULL };
+	ConfigRet   rets[3];
+	ConfigRet   ret;
+	int         i;
+
+	ENTER_TEST_FUNC;
+
+	ret = ConfigReadFiles(paths, 3, cfgs, rets, 2);
+	LOG_INFO("batch : %s", ConfigRetToString(ret));
+
+	for (i = 0; i < 3; ++i) {
+		if ((rets[i] == CONFIG_OK) != (cfgs[i] != NULL))
+			LOG_ERR("handle of %s does not match its result", paths[i]);
+		LOG_INFO("%s : %s, %d sections", paths[i], ConfigRetToString(rets[i]),
+				cfgs[i] ? ConfigGetSectionCount(cfgs[i]) : 0);
+		ConfigFree(cfgs[i]);
+	}
+
+	ret = ConfigReadFiles(paths, 0, cfgs, NULL, 0);
+	LOG_INFO("empty batch : %s", ConfigRetToString(ret));
+}
+
+static void *OpenSharedThread(void *arg)
+{
+	const Config **cfg = arg;
+
+	if (ConfigOpenShared(CONFIGREADFILE, cfg) != CONFIG_OK)
+		*cfg = NULL;
+
+	return NULL;
+}
+
+/*
+ * Open the same file as shared handle from several threads, release and reopen it
+ */
+static void Test25()
+{
+	const Config *cfgs[4] = { NULL, NULL, NULL, NULL };
+	const Config *cfg     = NULL;
+	pthread_t     tids[4];
+	int           i, n = 0;
+
+	ENTER_TEST_FUNC;
+
+	for (i = 0; i < 4; ++i) {
+		if (pthread_create(&tids[i], NULL, OpenSharedThread, &cfgs[i]) == 0)
+			++n;
+	}
+	for (i = 0; i < n; ++i)
+		pthread_join(tids[i], NULL);
+
+	for (i = 1; i < n; ++i) {
+		if (!cfgs[i] || (cfgs[i] != cfgs[0]))
+			LOG_ERR("handle %d is not shared", i);
+	}
+	LOG_INFO("%d opens : %s", n, (n && cfgs[0]) ? "same handle" : "failed");
+
+	for (i = 0; i < n; ++i)
+		ConfigRelease(cfgs[i]);
+
+	if (ConfigOpenShared(CONFIGREADFILE, &cfg) != CONFIG_OK) {
+		LOG_ERR("ConfigOpenShared failed for %s after release", CONFIGREADFILE);
+		return;
+	}
+	LOG_INFO("reopened : %d sections", ConfigGetSectionCount(cfg));
+	ConfigRelease(cfg);
+}
+
 
 int main()
 {
@@ -154,6 +997,27 @@ int main()
 	Test2();
 	Test3();
 	Test4();
+	Test5();
+	Test6();
+	Test7();
+	Test8();
+	Test9();
+	Test10();
+	Test11();
+	Test12();
+	Test13();
+	Test14();
+	Test15();
+	Test16();
+	Test17();
+	Test18();
+	Test19();
+	Test20();
+	Test21();
+	Test22();
+	Test23();
+	Test24();
+	Test25();
 
 	return 0;
 }